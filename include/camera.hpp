@@ -8,6 +8,9 @@
 
 #include <atomic>
 
+// Far enough to see the far terrain, all the way to its last ring
+#define CAMERA_FAR_PLANE 12000.0f
+
 class Camera
 {
 
@@ -17,7 +20,7 @@ public:
         view = glm::mat4(1.0f);
 
 	// This matrix needs to be also updated in viewPortCallback whenever it is changed
-        projection = glm::perspective(glm::radians(90.0f), 800.0f / 600.0f, 0.1f, 1200.0f);
+        projection = glm::perspective(glm::radians(90.0f), 800.0f / 600.0f, 0.1f, CAMERA_FAR_PLANE);
 
 	posX = cameraPos.x;
 	posY = cameraPos.y;
@@ -50,13 +53,16 @@ public:
         direction.y = sin(glm::radians(pitch));
         direction.z = sin(glm::radians(yaw)) * cos(glm::radians(pitch));
         cameraFront = glm::normalize(direction);
+	frontX = cameraFront.x;
+	frontY = cameraFront.y;
+	frontZ = cameraFront.z;
 
         view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
     }
 
     void viewPortCallBack(GLFWwindow *window, int width, int height)
     {
-        projection = glm::perspective(glm::radians(80.0f), (float)width / (float)height, 0.1f, 1200.0f);
+        projection = glm::perspective(glm::radians(80.0f), (float)width / (float)height, 0.1f, CAMERA_FAR_PLANE);
     }
 
     void mouseCallback(GLFWwindow *window, double xpos, double ypos)
@@ -88,6 +94,7 @@ public:
     float getAtomicPosX() { return posX; }
     float getAtomicPosY() { return posY; }
     float getAtomicPosZ() { return posZ; }
+    glm::vec3 getAtomicFront() { return glm::vec3(frontX.load(), frontY.load(), frontZ.load()); }
 
     // Plane extraction as per Gribb&Hartmann
     // 6 planes, each with 4 components (a,b,c,d)
@@ -127,6 +134,7 @@ private:
     float yaw, pitch;
 
     std::atomic<float> posX, posY, posZ;
+    std::atomic<float> frontX{0.0f}, frontY{0.0f}, frontZ{-1.0f};
 };
 
 #endif
@@ -8,6 +8,7 @@
 #include <atomic>
 #include <array>
 #include <bitset>
+#include <memory>
 #include <mutex>
 #include <vector>
 
@@ -19,17 +20,33 @@
 #define CHUNK_SIZE 32
 #define CHUNK_VOLUME (CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE)
 #define CHUNK_MAX_INDEX (CHUNK_VOLUME - 1)
+// Number of slices the mesher splits a chunk mesh into: one for each of the 6 face directions and
+// each of the CHUNK_SIZE+1 boundaries between layers of voxels (chunk borders included)
+#define CHUNK_MESH_SLICES (6 * (CHUNK_SIZE + 1))
+// Which faces of a chunk can see each other through non opaque voxels. Faces are numbered 2*dim
+// for the negative side along dim and 2*dim+1 for the positive one, each of the 15 pairs of faces
+// gets a bit
+#define CHUNK_CONNECTIVITY_ALL 0x7FFF
+// Neighbours of a chunk, one bit per face numbered as above
+#define CHUNK_NEIGHBOURS_ALL 0x3F
 
 // int32_t is fine, since i'm limiting the coordinate to only use up to ten bits (1023). There's actually two spare bits
 typedef int32_t chunk_index_t;
 typedef int16_t chunk_intcoord_t;
 typedef uint16_t chunk_state_t;
 
+// Defined in chunkmeshdata.hpp
+struct ChunkMeshSlices;
+// Solid blocks of a chunk, indexed by x + y * CHUNK_SIZE + z * CHUNK_SIZE * CHUNK_SIZE
+typedef std::bitset<CHUNK_VOLUME> ChunkOccupancy;
+
 namespace Chunk
 {
 
     chunk_index_t calculateIndex(chunk_intcoord_t i, chunk_intcoord_t j, chunk_intcoord_t k);
     chunk_index_t calculateIndex(glm::vec3 pos);
+    int facePairBit(int a, int b);
+    bool facesConnected(uint16_t connectivity, int a, int b);
 
     constexpr chunk_state_t CHUNK_STATE_GENERATED = 1;
     constexpr chunk_state_t CHUNK_STATE_MESHED = 2;
@@ -41,6 +58,8 @@ namespace Chunk
     constexpr chunk_state_t CHUNK_STATE_IN_GENERATION_QUEUE = 128;
     constexpr chunk_state_t CHUNK_STATE_IN_MESHING_QUEUE = 256;
     constexpr chunk_state_t CHUNK_STATE_IN_DELETING_QUEUE = 512;
+    // Created ahead of the player by the prefetcher, and not yet reached by the render volume
+    constexpr chunk_state_t CHUNK_STATE_PREFETCHED = 1024;
 
     int coord3DTo1D(int x, int y, int z);
 
@@ -64,10 +83,61 @@ namespace Chunk
 
         void setBlock(Block b, int x, int y, int z);
         void setBlocks(int start, int end, Block b);
+	// Replace all the blocks at once, arr is indexed along the Hilbert curve
+	void setBlocksArray(Block* arr, int length);
+	// Built the first time it is asked for, and thrown away whenever the blocks change. Like the
+	// blocks, it must be read while holding the chunk in the chunk table
+	std::shared_ptr<const ChunkOccupancy> getOccupancy();
         Block getBlock(int x, int y, int z);
         IntervalMap<Block>& getBlocks() { return (this->blocks); }
 	std::unique_ptr<Block[]> getBlocksArray(int* len) { return (this->blocks.toArray(len)); }
 
+	// Per-slice quads from the last time the chunk was meshed, owned by the chunk
+	ChunkMeshSlices* getMeshSlices() { return this->mesh_slices.get(); }
+	void setMeshSlices(ChunkMeshSlices* slices);
+	// Mark which layers need to be meshed again. A layer is the boundary between voxels
+	// layer-1 and layer along dimension dim, so it goes from 0 to CHUNK_SIZE
+	void setLayerDirty(int dim, int layer) { this->dirty_layers[dim].fetch_or(1ULL << layer); }
+	void setBlockDirty(int x, int y, int z);
+	uint64_t takeDirtyLayers(int dim) { return this->dirty_layers[dim].exchange(0); }
+	// Time of the oldest player edit not yet meshed, 0 if there is none. Carried along to the
+	// renderer to measure how long an edit takes to show up
+	void markEdited(float time) { float none{0}; this->edit_time.compare_exchange_strong(none, time); }
+	float takeEditTime() { return this->edit_time.exchange(0); }
+	// Jobs (generation, meshing) are queued with the current ticket of the chunk. Cancelling
+	// changes the ticket, so that queued jobs are recognized as stale and thrown away
+	uint32_t getJobTicket() { return this->job_ticket; }
+	void cancelJobs() { this->job_ticket++; }
+	// Generation jobs in the queue for the chunk. A prefetched chunk promoted to normal priority
+	// has two until the old one comes out, CHUNK_STATE_IN_GENERATION_QUEUE stays set until the
+	// last one is done
+	void addGenerationJob() { this->generation_jobs++; }
+	bool finishGenerationJob() { return --this->generation_jobs == 0; }
+	// Same for meshing jobs. Player edits queue a new mesh even if one is already waiting, as the
+	// waiting one might have read the blocks before the edit
+	void addMeshingJob() { this->meshing_jobs++; }
+	bool finishMeshingJob() { return --this->meshing_jobs == 0; }
+	// Level of detail the chunk is meshed at, chosen by the chunk manager
+	int getLod() { return this->lod; }
+	void setLod(int l) { this->lod = l; }
+	// Level of detail of the last mesh built, set by the mesher. Differs from getLod() while a
+	// new mesh is queued, or if the job was dropped before it ran
+	int getMeshLod() { return this->mesh_lod; }
+	void setMeshLod(int l) { this->mesh_lod = l; }
+	// Which neighbours are generated, kept up to date by the chunk manager as chunks are
+	// generated and unloaded
+	uint8_t getNeighbours() { return this->neighbours; }
+	void setNeighbour(int face, bool value) {
+	    if(value) this->neighbours |= (1 << face);
+	    else this->neighbours &= ~(1 << face);
+	}
+	// Face connectivity, computed by the mesher
+	uint16_t getConnectivity() { return this->connectivity; }
+	void setConnectivity(uint16_t c) { this->connectivity = c; }
+	// Set when blocks change between air and not air, connectivity only needs to be computed
+	// again then
+	bool takeConnectivityDirty() { return this->connectivity_dirty.exchange(false); }
+
     public:
 	std::atomic<float> unload_timer{0};
 	chunk_index_t getIndex(){ return this->index; }
@@ -78,6 +148,20 @@ namespace Chunk
         
 	std::atomic<chunk_state_t> state{0};
 	chunk_index_t index;
+
+	std::unique_ptr<ChunkMeshSlices> mesh_slices;
+	std::array<std::atomic<uint64_t>, 3> dirty_layers;
+	std::atomic<uint16_t> connectivity{CHUNK_CONNECTIVITY_ALL};
+	std::atomic<bool> connectivity_dirty{true};
+	std::atomic<uint8_t> lod{0};
+	std::atomic<uint8_t> mesh_lod{0};
+	std::atomic<uint32_t> job_ticket{0};
+	std::atomic<uint8_t> generation_jobs{0};
+	std::atomic<uint16_t> meshing_jobs{0};
+	std::atomic<uint8_t> neighbours{0};
+	std::atomic<float> edit_time{0};
+	// Accessed with std::atomic_load and std::atomic_store
+	std::shared_ptr<const ChunkOccupancy> occupancy;
     };
 };
 
@@ -4,5 +4,8 @@
 #include "chunk.hpp"
 
 void generateChunk(Chunk::Chunk *chunk);
+// Height of the grass at world position (x, z). Only depends on the 2D noise, can be called from
+// any thread
+int terrainHeight(int x, int z);
 
 #endif
\ No newline at end of file
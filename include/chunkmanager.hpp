@@ -4,7 +4,9 @@
 #include <oneapi/tbb/concurrent_hash_map.h>
 #include <oneapi/tbb/concurrent_queue.h>
 #include <oneapi/tbb/concurrent_priority_queue.h>
+#include <memory>
 #include <thread>
+#include <vector>
 
 #include "chunk.hpp"
 #include "globals.hpp"
@@ -13,29 +15,91 @@
 // Seconds to be passed outside of render distance for a chunk to be destroyed
 #define UNLOAD_TIMEOUT 10
 
-#define	MESHING_PRIORITY_NORMAL 0
+// How far (in blocks) the player can break and place blocks
+#define BLOCKPICK_REACH 10.0f
+
+// Higher priorities are processed first
+#define MESHING_PRIORITY_NORMAL 1
 #define MESHING_PRIORITY_PLAYER_EDIT 10
-#define GENERATION_PRIORITY_NORMAL 0
+#define GENERATION_PRIORITY_PREFETCH 0
+#define GENERATION_PRIORITY_NORMAL 1
+
+// Chunks are prefetched around where the player is predicted to be this many seconds from now
+#define PREFETCH_LOOKAHEAD 2.0f
+// Below this speed (blocks per second) there is nothing to predict
+#define PREFETCH_MIN_SPEED 4.0f
+// Limits on the chunks created by a single prefetch pass, and on those waiting for generation
+#define PREFETCH_MAX_PER_UPDATE 64
+#define PREFETCH_MAX_PENDING 512
+
+// Past these sizes the update loop stops queueing new jobs, and tries again at the next update.
+// Edits from the player are always queued
+#define GENERATION_QUEUE_LIMIT 1024
+#define MESHING_QUEUE_LIMIT 512
+
+// Distance (in chunks, along the furthest axis) from the player at which each level of detail
+// starts. At level n chunks are meshed with voxels 2^n blocks wide
+#define LOD_LEVELS 4
+#define LOD1_DISTANCE 6
+#define LOD2_DISTANCE 10
+#define LOD3_DISTANCE 14
+// Chunks only go back to a finer level of detail once this many chunks within its range
+#define LOD_HYSTERESIS 1
+
+// Shapes of the volume of chunks loaded around the player
+#define RENDER_SHAPE_CUBE 0
+#define RENDER_SHAPE_CYLINDER 1
+#define RENDER_SHAPE_SPHERE 2
 
 namespace chunkmanager
 {
     typedef oneapi::tbb::concurrent_hash_map<chunk_index_t, Chunk::Chunk*> ChunkTable;
-    typedef std::pair<Chunk::Chunk*, uint8_t> ChunkPQEntry;
-    // The comparing function to use
+    typedef struct ChunkPQEntry{
+	Chunk::Chunk* chunk;
+	uint8_t priority;
+	// Job ticket of the chunk when the entry was queued, see Chunk::cancelJobs
+	uint32_t ticket;
+    } ChunkPQEntry;
+    // The comparing function to use. The queue pops the entry with the highest priority first
     struct compare_f {
 	bool operator()(const ChunkPQEntry& u, const ChunkPQEntry& v) const {
-	    return u.second > v.second;
+	    return u.priority < v.priority;
 	}
     };
     typedef oneapi::tbb::concurrent_priority_queue<ChunkPQEntry, compare_f> ChunkPriorityQueue;
 
+    // Size (in chunks) and shape of the volume of chunks loaded around the player. A new one is
+    // made when the settings change, so that other threads never see a mix of old and new values
+    typedef struct RenderVolume{
+	int distance, height, shape;
+
+	// Whether a chunk at the given offset (in chunks) from the player is inside
+	bool contains(int dx, int dy, int dz) const;
+    } RenderVolume;
+
     void init();
     void update();
     void stop();
     void destroy();
     WorldUpdateMsgQueue& getWorldUpdateQueue();
-    std::array<std::array<chunk_intcoord_t, 3>, chunks_volume>& getChunksIndices();
+    ChunkTable& getChunks();
+    std::vector<std::array<chunk_intcoord_t, 3>>& getChunksIndices();
+    void build_chunks_indices();
+    // Whether a chunk at the given offset (in chunks) from the player is in the render volume
+    bool inRenderVolume(int dx, int dy, int dz);
+    std::shared_ptr<const RenderVolume> getRenderVolume();
     Block getBlockAtPos(int x, int y, int z);
+    // Copy the blocks of [min, max] (in blocks, inclusive) to buffer, indexed by
+    // (x * size.y + y) * size.z + z with size = max - min + 1. Blocks of chunks that are not loaded
+    // are NULLBLK, as with getBlockAtPos. Each chunk is locked once, for reading
+    void getBlocksInRegion(glm::ivec3 min, glm::ivec3 max, Block* buffer);
+    // Sorted ranges [first, second) of the Hilbert indices of the blocks of [lo, hi], in chunk
+    // coordinates. Valid until the next call from the same thread
+    const std::vector<std::pair<int, int>>& hilbert_ranges(glm::ivec3 lo, glm::ivec3 hi);
+    int lodForDistance(int distance, int current);
+    void prefetch(glm::vec3 position, glm::ivec3 chunk);
+    bool send_to_chunk_generation_thread(Chunk::Chunk* c, int priority);
+    bool send_to_chunk_meshing_thread(Chunk::Chunk* c, int priority);
 }
 
 #endif
@@ -8,29 +8,102 @@ enum class ChunkMeshDataType{
     MESH_UPDATE
 };
 
+// A single quad generated by the greedy mesher, packed in 8 bytes and decoded in the vertex
+// shader. All the attributes of the quad are in a single record, so that the mesher writes it in
+// one go and the renderer uploads it with a single buffer.
+//
+// word 0: bits 0-17: bottom left corner, 6 bits per axis (0 to CHUNK_SIZE)
+//         bits 18-22: width - 1, along the axis following the face dimension
+//         bits 23-27: height - 1, along the axis after that
+//         bits 28-29: dimension the face is perpendicular to
+//         bit 30: 0 if the face is a back face, 1 otherwise
+// word 1: bits 0-7: block type
+//         bits 8-23: slot of the chunk in the renderer, filled in when the quad is uploaded
+//         bits 24-25: level of detail. Position and size are in voxels 2^lod blocks wide
+typedef struct ChunkMeshQuad{
+    GLuint data[2];
+
+    int x() const { return data[0] & 63; }
+    int y() const { return (data[0] >> 6) & 63; }
+    int z() const { return (data[0] >> 12) & 63; }
+    int width() const { return ((data[0] >> 18) & 31) + 1; }
+    int height() const { return ((data[0] >> 23) & 31) + 1; }
+    int dim() const { return (data[0] >> 28) & 3; }
+    bool front() const { return (data[0] >> 30) & 1; }
+    int blocktype() const { return data[1] & 255; }
+    int lod() const { return (data[1] >> 24) & 3; }
+    void setSlot(int slot) { data[1] = (data[1] & ~(65535u << 8)) | (slot << 8); }
+
+    // Corner and size of the quad in blocks, whatever the level of detail
+    glm::ivec3 corner() const { return glm::ivec3(x(), y(), z()) << lod(); }
+    glm::ivec3 extents() const {
+	glm::ivec3 e(0);
+	e[(dim() + 1) % 3] = width() << lod();
+	e[(dim() + 2) % 3] = height() << lod();
+	return e;
+    }
+    int area() const { return (width() * height()) << (2 * lod()); }
+
+    static ChunkMeshQuad pack(int x, int y, int z, int width, int height, int dim, bool front, int
+	    blocktype, int lod = 0){
+	ChunkMeshQuad q;
+	q.data[0] = x | (y << 6) | (z << 12) | ((width - 1) << 18) | ((height - 1) << 23) | (dim << 28)
+	    | (front << 30);
+	q.data[1] = (blocktype & 255) | (lod << 24);
+	return q;
+    }
+}ChunkMeshQuad;
+
+// The quads of a chunk, split by slice (face direction and layer) as generated by the mesher.
+// Keeping them around allows to only run the greedy pass again on the slices touched by an edit
+struct ChunkMeshSlices{
+    // Quads of all the slices, in slice order
+    std::vector<ChunkMeshQuad> quads;
+    // Slice s spans quads[offsets[s], offsets[s+1])
+    std::array<uint32_t, CHUNK_MESH_SLICES + 1> offsets{};
+};
+
 typedef struct ChunkMeshData{
     chunk_index_t index;
     glm::vec3 position;
     int num_vertices = 0;
 
-    std::vector<GLfloat> vertices;
-    std::vector<GLfloat> extents;
-    std::vector<GLfloat> texinfo;
-    
+    std::vector<ChunkMeshQuad> quads;
+    // The quads are grouped by the direction they face: -X, -Y, -Z, +X, +Y, +Z. Direction d spans
+    // quads[direction_offsets[d], direction_offsets[d+1])
+    std::array<uint32_t, 7> direction_offsets{};
+    // Tight bounds of the quads, in chunk coordinates
+    glm::vec3 aabb_min, aabb_max;
+    // The biggest quads, used by the renderer as occluders
+    std::vector<ChunkMeshQuad> occluders;
+    // Which faces of the chunk can see each other, see CHUNK_CONNECTIVITY_ALL
+    uint16_t connectivity{CHUNK_CONNECTIVITY_ALL};
+    // Time of the player edit this mesh comes from, 0 if it doesn't come from an edit
+    float edit_time{0};
+
     ChunkMeshDataType message_type;
 
     void clear(){
-	vertices.clear();
-	texinfo.clear();
-	extents.clear();
+	// Keeps the allocated capacity, so that a mesh data object coming back from the renderer can
+	// be reused without reallocating
+	quads.clear();
+	occluders.clear();
 	index = 0;
 	position = glm::vec3(0);
 	num_vertices = 0;
+	aabb_min = glm::vec3(0);
+	aabb_max = glm::vec3(0);
+	connectivity = CHUNK_CONNECTIVITY_ALL;
+	edit_time = 0;
+	direction_offsets.fill(0);
     }
 
 }ChunkMeshData;
 typedef oneapi::tbb::concurrent_queue<ChunkMeshData*> ChunkMeshDataQueue;
+// Pool of mesh data objects shared between the mesher and the renderer. It holds a fixed number of
+// objects and is bounded to that number, the mesher blocks on it when the renderer is not giving
+// objects back fast enough
+typedef oneapi::tbb::concurrent_bounded_queue<ChunkMeshData*> ChunkMeshDataPool;
 
 
 #endif
-
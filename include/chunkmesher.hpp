@@ -14,21 +14,17 @@
 #include "globals.hpp"
 #include "shader.hpp"
 
-namespace chunkmesher{
-    struct MeshData{
-	Chunk::Chunk* chunk; 
-	GLuint numVertices{0};
-
-	std::vector<GLfloat> vertices;
-	std::vector<GLfloat> extents;
-	std::vector<GLfloat> texinfo;
-    };
+// Upper bound on the number of quads a single chunk can generate: each of the CHUNK_SIZE+1
+// boundaries between voxels (chunk borders included), in each of the 3 dimensions, holds at most
+// one face per voxel
+#define CHUNK_MESH_MAX_QUADS (3 * CHUNK_SIZE * CHUNK_SIZE * (CHUNK_SIZE + 1))
 
-    ChunkMeshDataQueue& getMeshDataQueue();
+namespace chunkmesher{
+    ChunkMeshDataPool& getMeshDataQueue();
     void init();
+    void stop();
     void mesh(Chunk::Chunk* chunk);
 }
 
 
 #endif
-
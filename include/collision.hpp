@@ -0,0 +1,62 @@
+#ifndef COLLISION_H
+#define COLLISION_H
+
+#include <memory>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "chunk.hpp"
+
+// Number of chunks remembered by a ChunkCache, enough for a 4x2x4 block of chunks
+#define COLLISION_CACHE_SIZE 32
+// Boxes stop this far from the blocks they collide with, so that they never end up touching them
+#define COLLISION_SKIN 0.001f
+
+// Parameters of the benchmark run from the debug window
+#define COLLISION_BENCHMARK_ENTITIES 10000
+#define COLLISION_BENCHMARK_STEPS 10
+
+// Axis aligned boxes moving through the blocks of the world. Blocks are tested against the
+// occupancy bitset of their chunk (see Chunk::getOccupancy). Chunks that are not loaded or not yet
+// generated are solid, as is everything outside of the world.
+// Safe to call from any thread
+namespace collision{
+    typedef struct Entity{
+	// Center of the box
+	glm::vec3 position;
+	glm::vec3 half_size;
+	// Blocks per second
+	glm::vec3 velocity;
+	// Standing on something after the last move
+	bool on_ground{false};
+    } Entity;
+
+    // Chunks looked up by the last queries. Entities close to each other go through the same
+    // chunks, keeping them around saves most of the lookups in the chunk table
+    typedef struct ChunkCache{
+	typedef struct Entry{
+	    chunk_index_t index{-1};
+	    // Null if the chunk is all solid or all air, as told by solid
+	    std::shared_ptr<const ChunkOccupancy> occupancy;
+	    bool solid{false};
+	} Entry;
+	Entry entries[COLLISION_CACHE_SIZE];
+	int hits{0}, misses{0};
+    } ChunkCache;
+
+    bool isSolid(ChunkCache& cache, glm::ivec3 block);
+    // Move the box [min, max] by motion, stopping at the first block in the way along each axis.
+    // Returns how much it actually moved, blocked tells which axes were stopped
+    glm::vec3 sweep(ChunkCache& cache, glm::vec3 min, glm::vec3 max, glm::vec3 motion, glm::bvec3*
+	    blocked = nullptr);
+    // Move all the entities by their velocity over dt seconds, in parallel. Velocity is zeroed along
+    // the axes where the entity was stopped
+    void moveBatch(std::vector<Entity>& entities, float dt);
+
+    // Move count entities scattered around origin, returns the number of entities moved per
+    // millisecond
+    double benchmark(glm::vec3 origin, int count, int steps);
+};
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "renderer.hpp"
+
+// Chunks are grouped in cubes of CULL_GROUP_SIZE^3 chunks, so that whole regions can be rejected
+// (or accepted) with a single test
+#define CULL_GROUP_SIZE 4
+
+namespace culling{
+    enum class Visibility{
+	OUTSIDE,
+	INTERSECT,
+	INSIDE
+    };
+
+    // The bounds of the chunks of a group are kept as a structure of arrays, so that they can be
+    // tested against the frustum 4 at a time
+    typedef struct CullGroup{
+	glm::vec3 min, max;
+
+	std::vector<float> min_x, min_y, min_z, max_x, max_y, max_z;
+	std::vector<renderer::RenderInfo*> members;
+    } CullGroup;
+
+    // Bounds are taken from render_info->aabb_min and aabb_max
+    void insert(renderer::RenderInfo* render_info);
+    void remove(renderer::RenderInfo* render_info);
+    void update(renderer::RenderInfo* render_info);
+    // Number of chunks in the culling arrays
+    int size();
+
+    Visibility testBox(glm::vec3 min, glm::vec3 max, const glm::vec4 planes[6]);
+    // Appends the chunks that are at least partially in the frustum to visible. Returns the number
+    // of chunks tested one by one
+    int cull(const glm::vec4 planes[6], std::vector<renderer::RenderInfo*>& visible);
+};
+
+#endif
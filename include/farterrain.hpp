@@ -0,0 +1,27 @@
+#ifndef FARTERRAIN_H
+#define FARTERRAIN_H
+
+#include <glm/glm.hpp>
+
+// Far terrain is made of FAR_TERRAIN_RINGS square rings around the voxel region. Each ring is twice
+// as wide as the previous one, and so are its cells. The first ring has cells
+// FAR_TERRAIN_CELL_SIZE blocks wide and covers about twice the voxel render distance
+#define FAR_TERRAIN_RINGS 4
+#define FAR_TERRAIN_CELL_SIZE 16
+// Blocks a grass texture spans on the far terrain, so that it doesn't shimmer in the distance
+#define FAR_TERRAIN_TEXTURE_SCALE 16.0f
+
+// Impostor terrain beyond the render distance. Only the 2D height function of the generator is
+// evaluated, on a coarse grid, and drawn as a heightfield: no voxels are generated or stored.
+// The heightfield is rebuilt on a separate thread when the player moves to another chunk or the
+// render volume changes, with a hole where the voxel chunks are
+namespace farterrain{
+    void init();
+    // Upload the new heightfield if one is ready, and start building another one if the player
+    // moved. Must be called from the rendering thread
+    void update(glm::vec3 cameraPos);
+    void render(const glm::mat4& view, const glm::mat4& projection, glm::vec3 cameraPos);
+    void destroy();
+};
+
+#endif
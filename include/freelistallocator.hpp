@@ -0,0 +1,119 @@
+#ifndef FREELISTALLOCATOR_H
+#define FREELISTALLOCATOR_H
+
+#include <cstdint>
+#include <iterator> //std::prev
+#include <map>
+
+// Sub-allocates ranges out of a linear space (e.g. a big GPU buffer), keeping track of the free
+// ranges. Allocation is best-fit, freed ranges are merged back with the adjacent free ones.
+// Offsets and sizes are in whatever unit the user decides (e.g. quads)
+class FreeListAllocator
+{
+
+public:
+    FreeListAllocator(uint32_t capacity = 0)
+    {
+        grow(capacity);
+    }
+
+    // Returns the offset of the allocated range, or -1 if there is no free range big enough
+    int64_t allocate(uint32_t size)
+    {
+        if (size == 0)
+            return -1;
+
+        const auto &best = free_by_size.lower_bound(size);
+        if (best == free_by_size.end())
+            return -1;
+
+        uint32_t free_size = best->first;
+        uint32_t offset = best->second;
+        erase(offset, free_size);
+
+        // Give back what's left of the free range
+        if (free_size > size)
+            insert(offset + size, free_size - size);
+
+        used += size;
+        return offset;
+    }
+
+    void release(uint32_t offset, uint32_t size)
+    {
+        if (size == 0)
+            return;
+
+        used -= size;
+
+        // Merge with the free range after
+        const auto &next = free_by_offset.find(offset + size);
+        if (next != free_by_offset.end())
+        {
+            size += next->second;
+            erase(next->first, next->second);
+        }
+
+        // Merge with the free range before
+        const auto &after = free_by_offset.lower_bound(offset);
+        if (after != free_by_offset.begin())
+        {
+            const auto &prev = std::prev(after);
+            if (prev->first + prev->second == offset)
+            {
+                offset = prev->first;
+                size += prev->second;
+                erase(prev->first, prev->second);
+            }
+        }
+
+        insert(offset, size);
+    }
+
+    // Extend the space to new_capacity, the new part is free
+    void grow(uint32_t new_capacity)
+    {
+        if (new_capacity <= capacity)
+            return;
+
+        uint32_t old_capacity = capacity;
+        capacity = new_capacity;
+        // Counted as used so that releasing it keeps the count right
+        used += new_capacity - old_capacity;
+        release(old_capacity, new_capacity - old_capacity);
+    }
+
+    uint32_t getCapacity() { return capacity; }
+    uint32_t getUsed() { return used; }
+    uint32_t getFreeRanges() { return free_by_offset.size(); }
+
+private:
+    void insert(uint32_t offset, uint32_t size)
+    {
+        free_by_offset[offset] = size;
+        free_by_size.emplace(size, offset);
+    }
+
+    void erase(uint32_t offset, uint32_t size)
+    {
+        free_by_offset.erase(offset);
+        const auto &range = free_by_size.equal_range(size);
+        for (auto i = range.first; i != range.second; i++)
+        {
+            if (i->second == offset)
+            {
+                free_by_size.erase(i);
+                break;
+            }
+        }
+    }
+
+    uint32_t capacity{0};
+    uint32_t used{0};
+    // offset -> size
+    std::map<uint32_t, uint32_t> free_by_offset{};
+    // size -> offset
+    std::multimap<uint32_t, uint32_t> free_by_size{};
+};
+
+#endif
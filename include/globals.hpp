@@ -10,11 +10,12 @@
 #define extr extern
 #endif
 
+// Default size of the volume of chunks loaded around the player, in chunks. Horizontal radius
+// and vertical half-height, can be changed at runtime (see chunkmanager)
 #define RENDER_DISTANCE 16
+#define RENDER_HEIGHT 6
 
 extr Camera theCamera;
-// the cube spans in both directions, to each axis has to be multiplied by 2. 2^3=8
-constexpr int chunks_volume = 8*(RENDER_DISTANCE*RENDER_DISTANCE*RENDER_DISTANCE);
 extr bool wireframe;
 
 extr float sines[360];
@@ -0,0 +1,42 @@
+#ifndef HEIGHTMAP_H
+#define HEIGHTMAP_H
+
+#include <array>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include "block.hpp"
+#include "chunk.hpp"
+
+// Height returned for columns with no block, or that are not loaded
+#define HEIGHTMAP_NONE -1
+
+// Highest non-air block of every column (x, z) of blocks in the world, among the chunks that are
+// generated. Columns of chunks keep the heights of their chunks, so that the surface can be told
+// without scanning through the blocks: the generator hands over the heights it already knows, edits
+// update them in place, and only removing the topmost block of a column has to look further down.
+// Safe to call from any thread. The updates are called by the chunk manager while holding the chunk
+// in the chunk table (when there is one), and never take a chunk themselves
+namespace heightmap{
+    // Chunk-local y of the highest non-air block of each column of a chunk, -1 if there is none.
+    // Indexed by x * CHUNK_SIZE + z
+    typedef std::array<int8_t, CHUNK_SIZE * CHUNK_SIZE> ChunkHeights;
+
+    // World y of the highest non-air block in (x, z), or HEIGHTMAP_NONE
+    int getHeight(int x, int z);
+    // Heights of all the columns of blocks of chunk column (cx, cz), indexed like ChunkHeights.
+    // Returns false if nothing in that column of chunks is generated
+    bool getHeights(int cx, int cz, int32_t* heights);
+
+    // A chunk was generated (or all of its blocks were replaced)
+    void setChunk(glm::ivec3 chunk, const ChunkHeights& heights);
+    // Same as setChunk, with the heights taken from the blocks of the chunk
+    void updateChunk(Chunk::Chunk* c);
+    // A single block of c changed. x, y, z are chunk coordinates
+    void setBlock(Chunk::Chunk* c, int x, int y, int z, Block b);
+    // A chunk was unloaded
+    void removeChunk(glm::ivec3 chunk);
+};
+
+#endif
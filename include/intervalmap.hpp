@@ -40,7 +40,7 @@ public:
 
 	    auto e = treemap.upper_bound(end);
 	    // A little optimization: delete next key if it is of the same value of the end key
-	    if(e != treemap.end() && e->second == treemap[end]) treemap.erase(end_next_entry);
+	    if(e != treemap.end() && e->second == treemap[end]) treemap.erase(e);
         }
 
         // insert the start key. Replaces whatever value is already there. Do not place if the element before is of the same value
@@ -61,6 +61,65 @@ public:
 	return r->second;
     }
 
+    // Calls f(run_start, run_end, value) for each run of the same value overlapping [start, end),
+    // clipped to it
+    template <typename F>
+    void forEachRun(int start, int end, F f)
+    {
+        if (start >= end || treemap.empty())
+            return;
+
+        // The run containing start begins at the last key not greater than it
+        auto i = treemap.upper_bound(start);
+        if (i != treemap.begin())
+            i = std::prev(i);
+
+        // The last key only marks where the map ends
+        for (auto next = std::next(i); next != treemap.end() && i->first < end; i = next, next++)
+        {
+            const int run_start = i->first > start ? i->first : start;
+            const int run_end = next->first < end ? next->first : end;
+            if (run_start < run_end)
+                f(run_start, run_end, i->second);
+        }
+    }
+
+    // Same as forEachRun for each of the ranges [first, second), which must be sorted and not
+    // overlapping. The map is walked once, only jumping ahead with a lookup over the gaps between
+    // ranges that skip whole runs
+    template <typename R, typename F>
+    void forEachRunInRanges(const R &ranges, F f)
+    {
+        if (treemap.empty())
+            return;
+
+        auto i = treemap.begin();
+        for (const auto &range : ranges)
+        {
+            const int start = range.first, end = range.second;
+            auto next = std::next(i);
+            if (next != treemap.end() && next->first <= start)
+            {
+                const auto u = treemap.upper_bound(start);
+                i = u != treemap.begin() ? std::prev(u) : u;
+                next = std::next(i);
+            }
+
+            for (; next != treemap.end() && i->first < end; i = next, next++)
+            {
+                const int run_start = i->first > start ? i->first : start;
+                const int run_end = next->first < end ? next->first : end;
+                if (run_start < run_end)
+                    f(run_start, run_end, i->second);
+                // The next range might start in the same run
+                if (next->first > end)
+                    break;
+            }
+            if (next == treemap.end())
+                return;
+        }
+    }
+
     void print()
     {
         for (auto i = treemap.begin(); i != treemap.end(); i++)
@@ -100,8 +159,8 @@ public:
             return;
 
         V prev = arr[0];
-        unsigned int prev_start = 0;
-        for (unsigned int i = 1; i < length; i++)
+        int prev_start = 0;
+        for (int i = 1; i < length; i++)
         {
             if (prev != arr[i])
             {
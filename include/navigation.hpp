@@ -0,0 +1,59 @@
+#ifndef NAVIGATION_H
+#define NAVIGATION_H
+
+#include <bitset>
+#include <future>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "chunk.hpp"
+
+// Threads answering path requests
+#define NAVIGATION_WORKERS 2
+// A search gives up after expanding this many portals
+#define NAVIGATION_MAX_EXPANSIONS 20000
+// Invalidation stamps kept before the ones no build in progress needs are pruned
+#define NAVIGATION_MAX_STAMPS 4096
+
+// Paths for agents walking on the terrain, two blocks tall. An agent stands in an air block above
+// a solid one, with air above its head, and moves to one of the 4 blocks next to it, stepping up
+// or down by one block at most.
+// Searches are hierarchical (HPA*): each chunk is summarized by its portals, the blocks where an
+// agent can walk into another chunk, with the walking distance between the portals of the chunk.
+// Paths are searched over the portals, then refined block by block inside each chunk.
+// Chunks are summarized when a search first needs them, and thrown away when they (or the chunks
+// around them) change
+namespace navigation{
+    typedef std::vector<glm::ivec3> Path;
+
+    typedef struct Edge{
+	glm::ivec3 to;
+	int cost;
+    } Edge;
+
+    typedef struct NavChunk{
+	glm::ivec3 position;
+	// Blocks an agent can stand in, and blocks with air two blocks above (needed to step up from
+	// there). Indexed by x + y * CHUNK_SIZE + z * CHUNK_SIZE^2
+	std::bitset<CHUNK_VOLUME> walkable, headroom;
+	// Portals, in world coordinates, with their edges to the other portals of the chunk and to
+	// the portals of the other chunks they lead to
+	std::vector<glm::ivec3> portals;
+	std::vector<std::vector<Edge>> edges;
+    } NavChunk;
+
+    void init();
+    void stop();
+
+    // Positions are the blocks the agent stands in. The path goes from start to goal, both
+    // included, and is empty if there is none
+    Path findPath(glm::ivec3 start, glm::ivec3 goal);
+    // Same as findPath, on one of the navigation threads
+    std::future<Path> requestPath(glm::ivec3 start, glm::ivec3 goal);
+
+    // Blocks changed in the chunk, its summary and those of the chunks around it are out of date
+    void invalidate(glm::ivec3 chunk);
+};
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef OCCLUSIONCULLER_H
+#define OCCLUSIONCULLER_H
+
+#include <glm/glm.hpp>
+
+// Resolution of the software depth buffer. Must be a power of two
+#define OCCLUSION_WIDTH 256
+#define OCCLUSION_HEIGHT 128
+#define OCCLUSION_LEVELS 8
+
+// Quads smaller than this (in blocks) are not worth rasterizing as occluders
+#define OCCLUDER_MIN_AREA 16
+// Maximum number of occluders kept for each chunk, the biggest ones
+#define CHUNK_MAX_OCCLUDERS 16
+
+// CPU occlusion culling. Big quads near the camera are rasterized into a low resolution depth
+// buffer, then a hierarchical (Hi-Z) pyramid is built from it and bounding boxes are tested
+// against the level of the pyramid their screen rectangle fits in.
+// Doesn't touch OpenGL, so it can be used anywhere. Not thread safe: a single thread must own
+// each frame
+namespace occlusionculler{
+    // Starts a new frame, clearing the depth buffer
+    void beginFrame(const glm::mat4& viewProjection);
+    // Rasterizes the quad v0-v1-v2-v3 (world coordinates) into the depth buffer
+    void addOccluder(glm::vec3 v0, glm::vec3 v1, glm::vec3 v2, glm::vec3 v3);
+    // Builds the Hi-Z pyramid. Must be called after all the occluders are added, before testing
+    void buildHiZ();
+    // True if the box is for sure completely hidden behind the occluders
+    bool isOccluded(glm::vec3 min, glm::vec3 max);
+
+    int getOccluderCount();
+};
+
+#endif
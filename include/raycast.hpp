@@ -0,0 +1,46 @@
+#ifndef RAYCAST_H
+#define RAYCAST_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "block.hpp"
+
+// Parameters of the benchmark run from the debug window
+#define RAYCAST_BENCHMARK_RAYS 100000
+#define RAYCAST_BENCHMARK_DISTANCE 64.0f
+
+// Rays against the blocks of the loaded chunks. Voxels are visited exactly with Amanatides & Woo
+// traversal, chunks that are empty or not loaded are crossed in a single step.
+// Safe to call from any thread
+namespace raycast{
+    typedef struct Ray{
+	glm::vec3 origin;
+	glm::vec3 direction;
+	float max_distance;
+    } Ray;
+
+    typedef struct RayHit{
+	bool hit{false};
+	// The solid block that was hit, and the face it was hit on. block + normal is the block the
+	// ray came from (zero if the ray starts inside the block)
+	glm::ivec3 block{0};
+	glm::ivec3 normal{0};
+	// Distance along the ray at which it enters the block
+	float distance{0};
+	Block type{Block::NULLBLK};
+    } RayHit;
+
+    RayHit cast(glm::vec3 origin, glm::vec3 direction, float max_distance);
+    RayHit cast(const Ray& ray);
+    // Cast all the rays in parallel, hits[i] is the result of rays[i]
+    void castBatch(const std::vector<Ray>& rays, std::vector<RayHit>& hits);
+    // False if a solid block is in the way. The block containing to counts
+    bool lineOfSight(glm::vec3 from, glm::vec3 to);
+
+    // Cast count rays in random directions from origin, returns the number of rays per second
+    double benchmark(glm::vec3 origin, int count, float max_distance);
+};
+
+#endif
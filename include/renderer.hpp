@@ -14,35 +14,56 @@ namespace renderer{
 	chunk_index_t index;
 	int num_vertices;
 	glm::vec3 position;
-	bool buffers_allocated=false;
 
-	GLuint VAO, VBO, extentsBuffer, texinfoBuffer;
-
-	void allocateBuffers(){
-	    // Allocate buffers
-	    glGenVertexArrays(1, &VAO);
-	    glGenBuffers(1, &VBO);
-	    glGenBuffers(1, &extentsBuffer);
-	    glGenBuffers(1, &texinfoBuffer);
-
-	    buffers_allocated=true;
-	}
-
-	void deallocateBuffers(){
-	    // Allocate buffers
-	    glDeleteBuffers(1, &VBO);
-	    glDeleteBuffers(1, &extentsBuffer);
-	    glDeleteBuffers(1, &texinfoBuffer);
-	    glDeleteVertexArrays(1, &VAO);
-
-	    buffers_allocated=false;
-	}
+	// Range of the quad arena holding the mesh. The capacity can be bigger than the mesh, so
+	// that remeshing doesn't need a new allocation every time
+	int64_t arena_offset{-1};
+	uint32_t arena_capacity{0};
+	// Slot in the chunk positions buffer, used by the shaders to place the quads in the world
+	int slot{-1};
+
+	// Ranges of the mesh facing each direction, see ChunkMeshData
+	std::array<uint32_t, 7> direction_offsets{};
+
+	// Bounds of the quads in world coordinates, and position in the culling arrays
+	glm::vec3 aabb_min, aabb_max;
+	int cull_index{-1};
+	// Only used to sort the visible chunks
+	float camera_distance{0};
+	// Big quads of the mesh, to be rasterized for occlusion culling
+	std::vector<ChunkMeshQuad> occluders;
+	// Face connectivity of the chunk, and the last visibility search that reached it
+	uint16_t connectivity{CHUNK_CONNECTIVITY_ALL};
+	uint64_t reached_search{0};
     } RenderInfo;
 
     typedef oneapi::tbb::concurrent_queue<int32_t> IndexQueue;
 
+    typedef struct DrawList DrawList;
+
     void init(GLFWwindow* window);
+    DrawList& swap_draw_lists();
+    void request_draw_list(glm::vec4 frustumPlanes[6], glm::vec3 cameraPos, glm::mat4 viewProjection);
+    void occlusion_cull(std::vector<RenderInfo*>& chunks, DrawList& list);
+    bool connectivity_search(DrawList& list);
+    void build_draw_lists();
+    bool chunk_in_frustum(glm::vec3 chunk, glm::vec4 frustumPlanes[6]);
+    void schedule_uploads(glm::vec4 frustumPlanes[6], glm::vec3 cameraChunkPos);
+    void upload_mesh(ChunkMeshData* mesh_data);
+    void update_bounds(ChunkMeshData* mesh_data, RenderInfo* render_info);
+    void delete_chunk(chunk_index_t index);
     void send_chunk_to_gpu(ChunkMeshData* mesh_data, RenderInfo* render_info);
+    void ring_begin_frame();
+    ChunkMeshQuad* ring_reserve(uint32_t bytes, GLintptr arena_byte_offset);
+    bool ring_fits(uint32_t bytes);
+    void ring_end_frame();
+    void attach_arena();
+    bool arena_grow(uint32_t min_capacity);
+    bool arena_allocate(RenderInfo* render_info, uint32_t num_quads);
+    void arena_release(RenderInfo* render_info);
+    void slot_release(RenderInfo* render_info);
+    void process_deferred_frees();
+    int acquire_slot(glm::vec3 position);
     void render();
     void resize_framebuffer(int width, int height);
     void framebuffer_size_callback(GLFWwindow *window, int width, int height);
@@ -0,0 +1,46 @@
+#ifndef WORLDEDIT_H
+#define WORLDEDIT_H
+
+#include <cstddef>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "block.hpp"
+
+// Past this many runs, a chunk is rewritten as a whole instead of one run at a time
+#define WORLDEDIT_MAX_RUNS 512
+
+// Edits over regions of the world, for tools that change a lot of blocks at once. Changes are
+// applied to each chunk as runs along the Hilbert curve the blocks are stored in, and every chunk
+// touched by an edit (and the neighbours sharing an edited border) is sent to meshing only once,
+// when the edit is done.
+// Only chunks that are loaded and generated are edited, the rest of the region is left alone.
+// Positions are in blocks, bounds are inclusive.
+// Can be called from any thread (the render thread included) that isn't holding a chunk in the
+// chunk table. Chunks are held one at a time while they are written, and an edit never waits on
+// the mesher for longer than it takes to copy the blocks of a chunk
+namespace worldedit{
+    // Blocks copied out of the world. NULLBLK marks blocks that were not loaded
+    typedef struct Region{
+	glm::ivec3 size{0};
+	// Indexed by (x * size.y + y) * size.z + z
+	std::vector<Block> blocks;
+
+	Block at(int x, int y, int z) const { return blocks[(x * size.y + y) * size.z + z]; }
+    } Region;
+
+    // All return the number of blocks changed
+    size_t fill(glm::ivec3 min, glm::ivec3 max, Block b);
+    // Ellipsoid with the given radii along each axis
+    size_t ellipsoid(glm::vec3 center, glm::vec3 radii, Block b);
+    size_t sphere(glm::vec3 center, float radius, Block b);
+    size_t replace(glm::ivec3 min, glm::ivec3 max, Block from, Block to);
+
+    Region copy(glm::ivec3 min, glm::ivec3 max);
+    // Place the region with its first corner at position. With skip_air, air in the region keeps
+    // what's already in the world
+    size_t paste(const Region& region, glm::ivec3 position, bool skip_air = false);
+};
+
+#endif
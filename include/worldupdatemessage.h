@@ -19,6 +19,7 @@ typedef struct WorldUpdateMsg{
     Block block;
 } WorldUpdateMsg;
 
-typedef oneapi::tbb::concurrent_queue<WorldUpdateMsg> WorldUpdateMsgQueue;
+// Bounded only to be able to block on it: the edit thread sleeps until a message comes in
+typedef oneapi::tbb::concurrent_bounded_queue<WorldUpdateMsg> WorldUpdateMsgQueue;
 
 #endif
@@ -0,0 +1,22 @@
+#version 330 core
+
+// Far terrain heightfield, shaded like the voxel terrain
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform float textureScale;
+uniform float grassLayer;
+
+out vec3 TexCoord;
+out vec3 Normal;
+out vec3 FragPos;
+
+void main()
+{
+    TexCoord = vec3(aPos.xz / textureScale, grassLayer);
+    Normal = aNormal;
+    FragPos = aPos;
+    gl_Position = projection * view * vec4(aPos, 1.0);
+}
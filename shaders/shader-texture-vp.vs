@@ -0,0 +1,55 @@
+#version 330 core
+
+// Vertex pulling: there are no vertex attributes. Each quad is expanded into two triangles (6
+// vertices) by fetching it from the quad buffer using gl_VertexID. See ChunkMeshQuad in
+// chunkmeshdata.hpp for the layout of a quad
+uniform usamplerBuffer quads;
+// World position of each chunk, indexed by the slot stored in the quad
+uniform samplerBuffer chunkPositions;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+out vec3 TexCoord;
+out vec3 Normal;
+out vec3 FragPos;
+
+// Normals, indexed by dimension | front << 2
+const vec3 normals[8] = vec3[8](
+    vec3(1.0, 0.0, 0.0), vec3(0.0, 1.0, 0.0), vec3(0.0, 0.0, 1.0), vec3(0.0),
+    vec3(-1.0, 0.0, 0.0), vec3(0.0, -1.0, 0.0), vec3(0.0, 0.0, -1.0), vec3(0.0)
+);
+// For each dimension, the axes along which the s and t texture coordinates run
+const ivec2 texAxes[3] = ivec2[3](ivec2(2, 1), ivec2(0, 2), ivec2(0, 1));
+// (s, t) corner of the quad for each of the 6 vertices
+const vec2 corners[6] = vec2[6](
+    vec2(0.0, 0.0), vec2(1.0, 0.0), vec2(0.0, 1.0),
+    vec2(0.0, 1.0), vec2(1.0, 0.0), vec2(1.0, 1.0)
+);
+
+void main()
+{
+    uvec2 quad = texelFetch(quads, gl_VertexID / 6).xy;
+
+    // Low detail quads are in voxels bigger than a block
+    float scale = float(1u << ((quad.y >> 24) & 3u));
+    vec3 pos = vec3(quad.x & 63u, (quad.x >> 6) & 63u, (quad.x >> 12) & 63u) * scale;
+    int dim = int((quad.x >> 28) & 3u);
+
+    // Width and height span the two axes following the dimension the face is perpendicular to
+    vec3 extents = vec3(0.0);
+    extents[(dim + 1) % 3] = float(((quad.x >> 18) & 31u) + 1u) * scale;
+    extents[(dim + 2) % 3] = float(((quad.x >> 23) & 31u) + 1u) * scale;
+
+    ivec2 axes = texAxes[dim];
+    vec2 st = corners[gl_VertexID % 6] * vec2(extents[axes.x], extents[axes.y]);
+    pos[axes.x] += st.x;
+    pos[axes.y] += st.y;
+
+    TexCoord = vec3(st, float(quad.y & 255u));
+    Normal = normals[(quad.x >> 28) & 7u];
+
+    vec4 worldPos = vec4(pos + texelFetch(chunkPositions, int((quad.y >> 8) & 65535u)).xyz, 1.0);
+    FragPos = vec3(worldPos);
+    gl_Position = projection * view * worldPos;
+}
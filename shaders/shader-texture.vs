@@ -1,10 +1,10 @@
 #version 330 core
 
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aExtents;
-layout (location = 2) in vec2 aInfo;
+// Packed quad, see ChunkMeshQuad in chunkmeshdata.hpp for the layout
+layout (location = 0) in uvec2 aQuad;
 
-uniform mat4 model;
+// World position of each chunk, indexed by the slot stored in the quad
+uniform samplerBuffer chunkPositions;
 
 out VS_OUT {
     vec3 Extents;
@@ -14,14 +14,21 @@ out VS_OUT {
 
 void main()
 {
-    //vNormal = mat3(transpose(inverse(model))) * aNormal;
-    vs_out.Extents = aExtents;
-    vs_out.BlockType = aInfo.y;
+    // Low detail quads are in voxels bigger than a block
+    float scale = float(1u << ((aQuad.y >> 24) & 3u));
+    vec3 aPos = vec3(aQuad.x & 63u, (aQuad.x >> 6) & 63u, (aQuad.x >> 12) & 63u) * scale;
+    int dim = int((aQuad.x >> 28) & 3u);
+    float front = float((aQuad.x >> 30) & 1u);
 
-    if(aExtents.x == 0) vs_out.Normal = vec3(1.0 - 2*aInfo.x, 0.0, 0.0);
-    else if(aExtents.y == 0) vs_out.Normal = vec3(0.0, 1.0 - 2*aInfo.x, 0.0);
-    else vs_out.Normal = vec3(0.0, 0.0, 1.0 - 2*aInfo.x);
-    vs_out.Normal = mat3(transpose(inverse(model))) * vs_out.Normal;
+    // Width and height span the two axes following the dimension the face is perpendicular to
+    vs_out.Extents = vec3(0.0);
+    vs_out.Extents[(dim + 1) % 3] = float(((aQuad.x >> 18) & 31u) + 1u) * scale;
+    vs_out.Extents[(dim + 2) % 3] = float(((aQuad.x >> 23) & 31u) + 1u) * scale;
+    vs_out.BlockType = float(aQuad.y & 255u);
 
-    gl_Position = model * vec4(aPos, 1.0);
+    vs_out.Normal = vec3(0.0);
+    // Quads are only translated, normals don't need to be transformed
+    vs_out.Normal[dim] = 1.0 - 2*front;
+
+    gl_Position = vec4(aPos + texelFetch(chunkPositions, int((aQuad.y >> 8) & 65535u)).xyz, 1.0);
 }
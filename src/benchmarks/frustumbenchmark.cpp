@@ -0,0 +1,103 @@
+// Headless benchmark of frustum culling: chunks filling a render volume around the camera are
+// culled through the groups of culling.cpp, and one box at a time as a reference, while the camera
+// turns around. Prints the fraction of chunks culled and the time taken by both, and fails if the
+// two ever disagree on a chunk.
+// Usage: FrustumBenchmark [frames]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "chunk.hpp"
+#include "culling.hpp"
+
+// Render volume, in chunks from the camera
+#define VOLUME_DISTANCE 16
+#define VOLUME_HEIGHT 4
+
+typedef std::chrono::steady_clock Clock;
+
+double microseconds(Clock::time_point start, Clock::time_point end){
+    return std::chrono::duration<double, std::micro>(end - start).count();
+}
+
+// Gribb & Hartmann, like Camera::getFrustumPlanes
+void frustumPlanes(const glm::mat4& vp, glm::vec4 planes[6]){
+    const glm::mat4 m = glm::transpose(vp);
+    for(int i = 0; i < 3; i++){
+	planes[2 * i] = m[3] + m[i];
+	planes[2 * i + 1] = m[3] - m[i];
+    }
+    for(int i = 0; i < 6; i++) planes[i] /= glm::length(glm::vec3(planes[i]));
+}
+
+int main(int argc, char** argv){
+    const int frames = argc > 1 ? std::max(std::atoi(argv[1]), 1) : 1000;
+
+    // Camera in the middle of the world, chunks all around it
+    const glm::vec3 center(512.0f * CHUNK_SIZE);
+    std::vector<renderer::RenderInfo> chunks;
+    chunks.reserve((2 * VOLUME_DISTANCE + 1) * (2 * VOLUME_HEIGHT + 1) * (2 * VOLUME_DISTANCE + 1));
+    for(int x = -VOLUME_DISTANCE; x <= VOLUME_DISTANCE; x++)
+	for(int y = -VOLUME_HEIGHT; y <= VOLUME_HEIGHT; y++)
+	    for(int z = -VOLUME_DISTANCE; z <= VOLUME_DISTANCE; z++){
+		renderer::RenderInfo r{};
+		r.position = glm::vec3(512 + x, 512 + y, 512 + z);
+		r.aabb_min = r.position * static_cast<float>(CHUNK_SIZE);
+		r.aabb_max = r.aabb_min + static_cast<float>(CHUNK_SIZE);
+		chunks.push_back(r);
+	    }
+    for(auto& r : chunks) culling::insert(&r);
+
+    const glm::mat4 projection = glm::perspective(glm::radians(90.0f), 16.0f / 9.0f, 0.1f, 1000.0f);
+    std::vector<renderer::RenderInfo*> visible;
+    // Whether each chunk was found visible by the groups in the current frame
+    std::vector<char> grouped(chunks.size());
+    double grouped_time{0}, brute_time{0};
+    long long grouped_visible{0}, brute_visible{0}, tested{0}, disagree{0};
+    for(int f = 0; f < frames; f++){
+	// A full turn over the run, looking a bit down
+	const float yaw = 2.0f * glm::pi<float>() * f / frames;
+	const glm::vec3 front(std::cos(yaw), -0.3f, std::sin(yaw));
+	glm::vec4 planes[6];
+	frustumPlanes(projection * glm::lookAt(center, center + front, glm::vec3(0.0f, 1.0f, 0.0f)),
+		planes);
+
+	const auto t0 = Clock::now();
+	visible.clear();
+	tested += culling::cull(planes, visible);
+	const auto t1 = Clock::now();
+	grouped_visible += visible.size();
+
+	int n{0};
+	for(const auto& r : chunks)
+	    if(culling::testBox(r.aabb_min, r.aabb_max, planes) != culling::Visibility::OUTSIDE) n++;
+	const auto t2 = Clock::now();
+	brute_visible += n;
+
+	std::fill(grouped.begin(), grouped.end(), 0);
+	for(const auto* r : visible) grouped[r - chunks.data()] = 1;
+	for(size_t i = 0; i < chunks.size(); i++)
+	    if(grouped[i] != (culling::testBox(chunks[i].aabb_min, chunks[i].aabb_max, planes) !=
+			culling::Visibility::OUTSIDE)) disagree++;
+
+	grouped_time += microseconds(t0, t1);
+	brute_time += microseconds(t1, t2);
+    }
+
+    const double total = static_cast<double>(chunks.size()) * frames;
+    std::cout << "Chunks: " << chunks.size() << ", frames: " << frames << std::endl;
+    std::cout << "Culled: " << 100.0 * (1.0 - grouped_visible / total) << "% (one by one: " << 100.0 *
+	(1.0 - brute_visible / total) << "%), tested one by one in groups: " << 100.0 * tested / total
+	<< "%" << std::endl;
+    std::cout << "Per frame (us): groups " << grouped_time / frames << ", one by one " << brute_time /
+	frames << std::endl;
+    std::cout << "Chunks where the two disagree, over all frames: " << disagree << std::endl;
+    return disagree == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
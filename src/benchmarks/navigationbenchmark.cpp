@@ -0,0 +1,183 @@
+// Headless benchmark of the pathfinding service: a synthetic heightfield, with walls that can only
+// be crossed through gaps, stands in for the chunk table. Paths between random points of the
+// surface are searched once with no chunk summarized (cold) and once more with all of them cached
+// (warm), then through the navigation threads. Every path is walked again to check that its steps
+// are legal, and a plain breadth first search over the columns tells which paths exist.
+// Prints the paths found, missed and failed and the time taken. Fails if a path is not legal, or if
+// one that exists is not found.
+// Usage: NavigationBenchmark [paths]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <future>
+#include <iostream>
+#include <queue>
+#include <random>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// The chunk code needs the globals, defined here as in main.cpp
+#define GLOBALS_DEFINER
+#include "globals.hpp"
+#undef GLOBALS_DEFINER
+
+#include "block.hpp"
+#include "chunk.hpp"
+#include "chunkmanager.hpp"
+#include "debugwindow.hpp"
+#include "navigation.hpp"
+
+// Loaded part of the world, in chunks along x and z from WORLD_ORIGIN. Everything else is not
+// loaded, and solid for the navigation
+#define WORLD_CHUNKS 8
+#define WORLD_ORIGIN (500 * CHUNK_SIZE)
+// The surface goes across a horizontal chunk border
+#define SURFACE_HEIGHT (16 * CHUNK_SIZE - 2)
+// Walls every WALL_SPACING blocks along x, too high to step on, with a gap every WALL_SPACING
+// blocks along z
+#define WALL_SPACING 64
+#define WALL_HEIGHT 3
+
+typedef std::chrono::steady_clock Clock;
+
+double milliseconds(Clock::time_point start, Clock::time_point end){
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+bool loaded(int x, int z){
+    return x >= WORLD_ORIGIN && z >= WORLD_ORIGIN && x < WORLD_ORIGIN + WORLD_CHUNKS * CHUNK_SIZE
+	&& z < WORLD_ORIGIN + WORLD_CHUNKS * CHUNK_SIZE;
+}
+
+// Highest solid block of the column
+int height(int x, int z){
+    int h = SURFACE_HEIGHT + static_cast<int>(std::lround(5.0 * std::sin(x / 9.0) * std::cos(z /
+		    13.0)));
+    const int wx = (x - WORLD_ORIGIN) % WALL_SPACING, wz = (z - WORLD_ORIGIN) % WALL_SPACING;
+    if(wx >= 30 && wx < 32 && !(wz >= 10 && wz < 14)) h += WALL_HEIGHT;
+    return h;
+}
+
+// The navigation reads the world through here only
+namespace chunkmanager{
+    void getBlocksInRegion(glm::ivec3 min, glm::ivec3 max, Block* buffer){
+	const glm::ivec3 size = max - min + 1;
+	for(int x = min.x; x <= max.x; x++)
+	    for(int z = min.z; z <= max.z; z++){
+		const int h = loaded(x, z) ? height(x, z) : 0;
+		for(int y = min.y; y <= max.y; y++)
+		    buffer[((x - min.x) * size.y + y - min.y) * size.z + z - min.z] = !loaded(x, z) ?
+			Block::NULLBLK : y <= h ? Block::STONE : Block::AIR;
+	    }
+    }
+};
+
+namespace debug{
+    namespace window{
+	void set_parameter(std::string, std::any){}
+    };
+};
+
+// Shortest path length between two columns, walking on the surface, -1 if there is none
+int referenceDistance(glm::ivec3 start, glm::ivec3 goal){
+    const int side = WORLD_CHUNKS * CHUNK_SIZE;
+    auto index = [&](int x, int z){ return (x - WORLD_ORIGIN) * side + z - WORLD_ORIGIN; };
+    std::vector<int> dist(side * side, -1);
+    std::queue<glm::ivec2> queue;
+    dist[index(start.x, start.z)] = 0;
+    queue.push(glm::ivec2(start.x, start.z));
+
+    const glm::ivec2 directions[4]{{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+    while(!queue.empty()){
+	const glm::ivec2 c = queue.front();
+	queue.pop();
+	if(c.x == goal.x && c.y == goal.z) return dist[index(c.x, c.y)];
+	for(const auto& d : directions){
+	    const glm::ivec2 n = c + d;
+	    if(!loaded(n.x, n.y) || dist[index(n.x, n.y)] >= 0) continue;
+	    if(std::abs(height(n.x, n.y) - height(c.x, c.y)) > 1) continue;
+	    dist[index(n.x, n.y)] = dist[index(c.x, c.y)] + 1;
+	    queue.push(n);
+	}
+    }
+    return -1;
+}
+
+// Starts at start, ends at goal, and only makes moves an agent can make
+bool legal(const navigation::Path& path, glm::ivec3 start, glm::ivec3 goal){
+    if(path.front() != start || path.back() != goal) return false;
+    for(size_t i = 0; i < path.size(); i++){
+	const glm::ivec3 p = path[i];
+	if(!loaded(p.x, p.z) || p.y != height(p.x, p.z) + 1) return false;
+	if(i == 0) continue;
+	const glm::ivec3 d = glm::abs(p - path[i - 1]);
+	if(d.x + d.z != 1 || d.y > 1) return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv){
+    const int count = argc > 1 ? std::max(std::atoi(argv[1]), 1) : 200;
+
+    std::mt19937 rng(1234);
+    std::uniform_int_distribution<int> coordinate(WORLD_ORIGIN, WORLD_ORIGIN + WORLD_CHUNKS *
+	    CHUNK_SIZE - 1);
+    auto standing = [&](){
+	const int x = coordinate(rng), z = coordinate(rng);
+	return glm::ivec3(x, height(x, z) + 1, z);
+    };
+    std::vector<std::pair<glm::ivec3, glm::ivec3>> queries(count);
+    for(auto& q : queries) q = {standing(), standing()};
+
+    int found{0}, missed{0}, failed{0}, illegal{0};
+    long long length{0}, reference_length{0};
+    auto check = [&](const navigation::Path& path, glm::ivec3 start, glm::ivec3 goal){
+	const int reference = referenceDistance(start, goal);
+	if(path.empty()){
+	    if(reference >= 0) missed++;
+	    else failed++;
+	    return;
+	}
+	found++;
+	if(!legal(path, start, goal) || reference < 0) illegal++;
+	length += path.size() - 1;
+	reference_length += reference;
+    };
+
+    const auto t0 = Clock::now();
+    std::vector<navigation::Path> cold;
+    for(const auto& [start, goal] : queries) cold.push_back(navigation::findPath(start, goal));
+    const auto t1 = Clock::now();
+    for(const auto& [start, goal] : queries) navigation::findPath(start, goal);
+    const auto t2 = Clock::now();
+
+    navigation::init();
+    std::vector<std::future<navigation::Path>> results;
+    for(const auto& [start, goal] : queries) results.push_back(navigation::requestPath(start, goal));
+    std::vector<navigation::Path> threaded;
+    for(auto& r : results) threaded.push_back(r.get());
+    const auto t3 = Clock::now();
+    navigation::stop();
+
+    for(size_t i = 0; i < threaded.size(); i++) check(threaded[i], queries[i].first, queries[i].second);
+
+    // The searches without the threads are checked too
+    for(size_t i = 0; i < cold.size(); i++)
+	if(!cold[i].empty() && !legal(cold[i], queries[i].first, queries[i].second)) illegal++;
+
+    std::cout << "Paths: " << count << " over " << WORLD_CHUNKS << "x" << WORLD_CHUNKS << " chunks"
+	<< std::endl;
+    std::cout << "Found: " << found << ", missed (a path exists): " << missed << ", failed (no path): "
+	<< failed << ", not legal: " << illegal << std::endl;
+    if(found > 0)
+	std::cout << "Length: " << static_cast<double>(length) / found << " steps on average, " <<
+	    100.0 * length / std::max(reference_length, 1LL) << "% of the shortest" << std::endl;
+    std::cout << "Per path (ms): cold " << milliseconds(t0, t1) / count << ", warm " <<
+	milliseconds(t1, t2) / count << ", on " << NAVIGATION_WORKERS << " threads " <<
+	milliseconds(t2, t3) / count << std::endl;
+    return illegal == 0 && missed == 0 && found > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,129 @@
+// Headless benchmark of the CPU occlusion culler: a wall of synthetic occluders in front of the
+// camera, and a grid of chunk sized boxes around and behind it. Prints the fraction of boxes culled
+// and the time spent on each step of a frame, and fails if a box that can be seen around the wall
+// is culled.
+// Usage: OcclusionBenchmark [frames]
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "chunk.hpp"
+#include "occlusionculler.hpp"
+
+// Distance of the wall from the camera, and its extent
+#define WALL_DISTANCE 48
+#define WALL_HALF_WIDTH 96
+#define WALL_BOTTOM -64
+#define WALL_TOP 16
+
+typedef std::chrono::steady_clock Clock;
+
+double microseconds(Clock::time_point start, Clock::time_point end){
+    return std::chrono::duration<double, std::micro>(end - start).count();
+}
+
+// Screen rectangle (normalized device coordinates) of points in front of the camera
+void project(const glm::mat4& vp, const std::vector<glm::vec3>& points, glm::vec2& min, glm::vec2&
+	max){
+    min = glm::vec2(INFINITY);
+    max = glm::vec2(-INFINITY);
+    for(const auto& p : points){
+	const glm::vec4 clip = vp * glm::vec4(p, 1.0f);
+	const glm::vec2 ndc = glm::vec2(clip) / clip.w;
+	min = glm::min(min, ndc);
+	max = glm::max(max, ndc);
+    }
+}
+
+int main(int argc, char** argv){
+    const int frames = argc > 1 ? std::max(std::atoi(argv[1]), 1) : 1000;
+
+    // Camera at the origin looking down -z, with the aspect of the depth buffer
+    const glm::mat4 projection = glm::perspective(glm::radians(90.0f), static_cast<float>(
+		OCCLUSION_WIDTH) / OCCLUSION_HEIGHT, 0.1f, 1000.0f);
+    const glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f,
+		1.0f, 0.0f));
+    const glm::mat4 vp = projection * view;
+
+    // The wall, made of quads the size of a chunk face like the ones the mesher hands out
+    std::vector<glm::vec3> occluders;
+    for(int x = -WALL_HALF_WIDTH; x < WALL_HALF_WIDTH; x += CHUNK_SIZE)
+	for(int y = WALL_BOTTOM; y < WALL_TOP; y += CHUNK_SIZE){
+	    const float z = -WALL_DISTANCE;
+	    occluders.insert(occluders.end(), {glm::vec3(x, y, z), glm::vec3(x + CHUNK_SIZE, y, z),
+		    glm::vec3(x + CHUNK_SIZE, y + CHUNK_SIZE, z), glm::vec3(x, y + CHUNK_SIZE, z)});
+	}
+
+    // Chunks from right in front of the camera to well behind the wall
+    std::vector<glm::vec3> boxes;
+    for(int cx = -8; cx < 8; cx++)
+	for(int cy = -3; cy < 2; cy++)
+	    for(int cz = -16; cz < -1; cz++)
+		boxes.push_back(glm::vec3(cx, cy, cz) * static_cast<float>(CHUNK_SIZE));
+
+    // A box can only be culled if it's in the shadow of the wall: all behind it, with the part of
+    // its screen rectangle that is on screen inside the rectangle of the wall. Boxes all off screen
+    // can't be seen anyway. The quads go past WALL_TOP when the height is not a multiple of their
+    // size, so the rectangle is taken from them
+    glm::vec2 wall_min, wall_max;
+    project(vp, occluders, wall_min, wall_max);
+    wall_min = glm::max(wall_min, glm::vec2(-1.0f));
+    wall_max = glm::min(wall_max, glm::vec2(1.0f));
+    std::vector<bool> shadowed;
+    for(const auto& min : boxes){
+	const glm::vec3 max = min + static_cast<float>(CHUNK_SIZE);
+	std::vector<glm::vec3> corners;
+	for(int i = 0; i < 8; i++)
+	    corners.push_back(glm::vec3(i & 1 ? max.x : min.x, i & 2 ? max.y : min.y, i & 4 ? max.z :
+			min.z));
+	glm::vec2 box_min, box_max;
+	project(vp, corners, box_min, box_max);
+	const bool off_screen = glm::any(glm::greaterThan(box_min, glm::vec2(1.0f))) ||
+	    glm::any(glm::lessThan(box_max, glm::vec2(-1.0f)));
+	box_min = glm::max(box_min, glm::vec2(-1.0f));
+	box_max = glm::min(box_max, glm::vec2(1.0f));
+	shadowed.push_back(off_screen || (max.z <= -WALL_DISTANCE && glm::all(glm::greaterThanEqual(
+			    box_min, wall_min)) && glm::all(glm::lessThanEqual(box_max, wall_max))));
+    }
+
+    double raster_time{0}, hiz_time{0}, test_time{0};
+    int culled{0}, wrong{0};
+    for(int f = 0; f < frames; f++){
+	const auto t0 = Clock::now();
+	occlusionculler::beginFrame(vp);
+	for(size_t i = 0; i < occluders.size(); i += 4)
+	    occlusionculler::addOccluder(occluders[i], occluders[i + 1], occluders[i + 2],
+		    occluders[i + 3]);
+	const auto t1 = Clock::now();
+	occlusionculler::buildHiZ();
+	const auto t2 = Clock::now();
+
+	culled = wrong = 0;
+	for(size_t i = 0; i < boxes.size(); i++){
+	    if(!occlusionculler::isOccluded(boxes[i], boxes[i] + static_cast<float>(CHUNK_SIZE)))
+		continue;
+	    culled++;
+	    if(!shadowed[i]) wrong++;
+	}
+	const auto t3 = Clock::now();
+
+	raster_time += microseconds(t0, t1);
+	hiz_time += microseconds(t1, t2);
+	test_time += microseconds(t2, t3);
+    }
+
+    std::cout << "Occluders: " << occlusionculler::getOccluderCount() << ", boxes: " << boxes.size()
+	<< ", frames: " << frames << std::endl;
+    std::cout << "Culled: " << culled << " (" << 100.0 * culled / boxes.size() << "%), wrongly culled: "
+	<< wrong << std::endl;
+    std::cout << "Per frame (us): rasterize " << raster_time / frames << ", Hi-Z " << hiz_time / frames
+	<< ", tests " << test_time / frames << " (" << 1000.0 * test_time / frames / boxes.size() <<
+	" ns per box)" << std::endl;
+    return wrong == 0 ? 0 : 1;
+}
@@ -0,0 +1,281 @@
+// Headless benchmark of the region edits: a synthetic chunk table holds a block of terrain, with a
+// chunk that is not loaded, one that is loaded but not generated yet and one waiting to be
+// deleted. Random regions, crossing the chunks at odd places, are filled, replaced, carved with
+// spheres and pasted over, and after each edit the region (and a margin around it) is read back
+// with getBlocksInRegion and compared with a plain copy of the world edited one block at a time.
+// Only generated chunks that are not being deleted must change, every one that does must be sent
+// to meshing, and no other chunk may be.
+// Prints the blocks changed and the time taken by the edits and the reads. Fails if a block reads
+// back wrong, if the count of changed blocks is off, or if a chunk is meshed when it shouldn't be
+// or not when it should.
+// Usage: WorldEditBenchmark [edits]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <set>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// The chunk code needs the globals, defined here as in main.cpp
+#define GLOBALS_DEFINER
+#include "globals.hpp"
+#undef GLOBALS_DEFINER
+
+#include "block.hpp"
+#include "chunk.hpp"
+#include "chunkmanager.hpp"
+#include "heightmap.hpp"
+#include "navigation.hpp"
+#include "spacefilling.hpp"
+#include "worldedit.hpp"
+
+// Chunks of the table along each axis, starting from chunk WORLD_ORIGIN
+#define WORLD_CHUNKS 4
+#define WORLD_ORIGIN 100
+// Largest side of an edited region, not a multiple of the chunk size so that regions cross the
+// chunks at odd places
+#define EDIT_MAX_SIZE 70
+// Blocks around an edited region that are read back too, to catch edits leaking out of it
+#define EDIT_MARGIN 2
+
+typedef std::chrono::steady_clock Clock;
+
+double milliseconds(Clock::time_point start, Clock::time_point end){
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// Chunks, relative to WORLD_ORIGIN, that are not in the table, loaded but not generated, and
+// generated but queued for deletion
+const glm::ivec3 MISSING(1, 1, 2), NOT_GENERATED(2, 1, 1), DELETING(1, 2, 1);
+
+const glm::ivec3 WORLD_MIN(WORLD_ORIGIN * CHUNK_SIZE);
+const glm::ivec3 WORLD_SIZE(WORLD_CHUNKS * CHUNK_SIZE);
+
+chunkmanager::ChunkTable chunks;
+// Chunks sent to meshing since the last edit
+std::set<chunk_index_t> meshed;
+
+// The region edits reach the rest of the engine through here only
+namespace chunkmanager{
+    ChunkTable& getChunks(){ return chunks; }
+    bool send_to_chunk_meshing_thread(Chunk::Chunk* c, int){
+	meshed.insert(c->getIndex());
+	return true;
+    }
+};
+
+namespace heightmap{
+    void updateChunk(Chunk::Chunk*){}
+};
+
+namespace navigation{
+    void invalidate(glm::ivec3){}
+};
+
+// Copy of the world edited one block at a time, indexed like a worldedit::Region
+std::vector<Block> world;
+
+Block& worldAt(glm::ivec3 p){
+    const glm::ivec3 r = p - WORLD_MIN;
+    return world[(r.x * WORLD_SIZE.y + r.y) * WORLD_SIZE.z + r.z];
+}
+
+bool inWorld(glm::ivec3 p){
+    return glm::all(glm::greaterThanEqual(p, WORLD_MIN)) && glm::all(glm::lessThan(p, WORLD_MIN +
+		WORLD_SIZE));
+}
+
+// Chunk relative to WORLD_ORIGIN
+glm::ivec3 chunkOf(glm::ivec3 p){
+    return p / CHUNK_SIZE - WORLD_ORIGIN;
+}
+
+bool editable(glm::ivec3 p){
+    const glm::ivec3 c = chunkOf(p);
+    return inWorld(p) && c != MISSING && c != NOT_GENERATED && c != DELETING;
+}
+
+// What getBlocksInRegion must read at p
+Block expected(glm::ivec3 p){
+    if(!inWorld(p) || chunkOf(p) == MISSING) return Block::NULLBLK;
+    if(chunkOf(p) == NOT_GENERATED) return Block::AIR;
+    return worldAt(p);
+}
+
+Block terrain(glm::ivec3 p){
+    const int h = WORLD_MIN.y + WORLD_SIZE.y / 2 + static_cast<int>(std::lround(20.0 *
+		std::sin(p.x / 11.0) * std::cos(p.z / 17.0)));
+    if(p.y < h - 3) return Block::STONE;
+    if(p.y < h) return Block::DIRT;
+    if(p.y == h) return Block::GRASS;
+    return Block::AIR;
+}
+
+void buildWorld(){
+    world.assign(WORLD_SIZE.x * WORLD_SIZE.y * WORLD_SIZE.z, Block::AIR);
+    std::vector<Block> blocks(CHUNK_VOLUME);
+    for(int cx = 0; cx < WORLD_CHUNKS; cx++)
+    for(int cy = 0; cy < WORLD_CHUNKS; cy++)
+    for(int cz = 0; cz < WORLD_CHUNKS; cz++){
+	const glm::ivec3 chunk(cx, cy, cz);
+	if(chunk == MISSING) continue;
+	const glm::ivec3 origin = WORLD_MIN + chunk * CHUNK_SIZE;
+	Chunk::Chunk* c = new Chunk::Chunk(glm::vec3(chunk + WORLD_ORIGIN));
+	if(chunk != NOT_GENERATED){
+	    for(int h = 0; h < CHUNK_VOLUME; h++){
+		const glm::ivec3 p = origin + glm::ivec3(HILBERT_XYZ_DECODE[h][0],
+			HILBERT_XYZ_DECODE[h][1], HILBERT_XYZ_DECODE[h][2]);
+		blocks[h] = worldAt(p) = terrain(p);
+	    }
+	    c->setBlocksArray(blocks.data(), CHUNK_VOLUME);
+	    c->setState(Chunk::CHUNK_STATE_GENERATED, true);
+	}
+	if(chunk == DELETING) c->setState(Chunk::CHUNK_STATE_IN_DELETING_QUEUE, true);
+	chunks.insert(std::make_pair(c->getIndex(), c));
+    }
+}
+
+int main(int argc, char** argv){
+    const int count = argc > 1 ? std::max(std::atoi(argv[1]), 1) : 300;
+
+    SpaceFilling::initLUT();
+    buildWorld();
+
+    std::mt19937 rng(1234);
+    std::uniform_int_distribution<int> size(1, EDIT_MAX_SIZE), kind(0, 3), material(1, 6);
+    std::bernoulli_distribution coin;
+    // Regions may go a little past the table, where nothing is loaded
+    std::uniform_int_distribution<int> coordinate(WORLD_MIN.x - 8, WORLD_MIN.x + WORLD_SIZE.x - 8);
+    auto block = [&](){ return static_cast<Block>(material(rng)); };
+
+    long long changed{0}, wrong{0}, miscounted{0}, unmeshed{0}, overmeshed{0};
+    double edit_time{0}, read_time{0};
+    for(int e = 0; e < count; e++){
+	const glm::ivec3 min(coordinate(rng), coordinate(rng), coordinate(rng));
+	const glm::ivec3 max = min + glm::ivec3(size(rng), size(rng), size(rng)) - 1;
+
+	// New value of each block of [lo, hi], given the current one
+	glm::ivec3 lo = min, hi = max;
+	std::function<Block(glm::ivec3, Block)> f;
+	std::function<size_t()> edit;
+	switch(kind(rng)){
+	    case 0: {
+		const Block b = block();
+		f = [=](glm::ivec3, Block){ return b; };
+		edit = [=](){ return worldedit::fill(min, max, b); };
+		break;
+	    }
+	    case 1: {
+		const Block from = block(), to = block();
+		f = [=](glm::ivec3, Block current){ return current == from ? to : current; };
+		edit = [=](){ return worldedit::replace(min, max, from, to); };
+		break;
+	    }
+	    case 2: {
+		const glm::vec3 center = glm::vec3(min + max) / 2.0f + 0.3f;
+		const glm::ivec3 side = max - min;
+		const float radius = std::max(std::min({side.x, side.y, side.z}), 2) / 2.0f;
+		const Block b = block();
+		// Same bounds and same test, on the center of the block, as the edit
+		lo = glm::ivec3(glm::floor(center - radius));
+		hi = glm::ivec3(glm::ceil(center + radius));
+		f = [=](glm::ivec3 p, Block current){
+		    const glm::vec3 d = (glm::vec3(p) + glm::vec3(0.5f) - center) / glm::vec3(radius);
+		    return glm::dot(d, d) <= 1.0f ? b : current;
+		};
+		edit = [=](){ return worldedit::sphere(center, radius, b); };
+		break;
+	    }
+	    default: {
+		// A pattern with air and blocks that were not loaded, pasted over the world or
+		// only where it isn't air
+		const bool skip_air = coin(rng);
+		auto pattern = std::make_shared<worldedit::Region>();
+		pattern->size = max - min + 1;
+		pattern->blocks.resize(pattern->size.x * pattern->size.y * pattern->size.z);
+		for(auto& b : pattern->blocks){
+		    const int r = material(rng);
+		    b = r == 6 ? Block::NULLBLK : static_cast<Block>(r);
+		}
+		f = [=](glm::ivec3 p, Block current){
+		    const glm::ivec3 r = p - min;
+		    const Block b = pattern->at(r.x, r.y, r.z);
+		    if(b == Block::NULLBLK || (skip_air && b == Block::AIR)) return current;
+		    return b;
+		};
+		edit = [=](){ return worldedit::paste(*pattern, min, skip_air); };
+		break;
+	    }
+	}
+
+	// Expected changes, and the chunks that must be meshed again: the ones with a changed
+	// block, and the neighbours sharing a face with one on the border
+	size_t expected_changed{0};
+	std::set<chunk_index_t> expected_meshed;
+	for(int x = lo.x; x <= hi.x; x++)
+	for(int y = lo.y; y <= hi.y; y++)
+	for(int z = lo.z; z <= hi.z; z++){
+	    const glm::ivec3 p(x, y, z);
+	    if(!editable(p)) continue;
+	    const Block b = f(p, worldAt(p));
+	    if(b == worldAt(p)) continue;
+	    worldAt(p) = b;
+	    expected_changed++;
+	    const glm::ivec3 chunk = p / CHUNK_SIZE;
+	    expected_meshed.insert(Chunk::calculateIndex(chunk.x, chunk.y, chunk.z));
+	    for(int d = 0; d < 3; d++)
+		for(int side = -1; side <= 1; side += 2){
+		    const glm::ivec3 q = p + glm::ivec3(d == 0, d == 1, d == 2) * side;
+		    if(q / CHUNK_SIZE != chunk && editable(q)){
+			const glm::ivec3 n = q / CHUNK_SIZE;
+			expected_meshed.insert(Chunk::calculateIndex(n.x, n.y, n.z));
+		    }
+		}
+	}
+
+	meshed.clear();
+	const auto t0 = Clock::now();
+	const size_t edit_changed = edit();
+	const auto t1 = Clock::now();
+	const worldedit::Region read = worldedit::copy(lo - EDIT_MARGIN, hi + EDIT_MARGIN);
+	const auto t2 = Clock::now();
+	edit_time += milliseconds(t0, t1);
+	read_time += milliseconds(t1, t2);
+
+	changed += edit_changed;
+	if(edit_changed != expected_changed) miscounted++;
+	for(int x = 0; x < read.size.x; x++)
+	for(int y = 0; y < read.size.y; y++)
+	for(int z = 0; z < read.size.z; z++)
+	    if(read.at(x, y, z) != expected(lo - EDIT_MARGIN + glm::ivec3(x, y, z))) wrong++;
+	// Neighbours of a changed border may be meshed even if nothing on their side changed,
+	// chunks that can't be edited never are
+	for(chunk_index_t index : expected_meshed)
+	    if(meshed.find(index) == meshed.end()) unmeshed++;
+	for(chunk_index_t index : meshed){
+	    chunkmanager::ChunkTable::const_accessor a;
+	    if(!chunks.find(a, index) || !a->second->getState(Chunk::CHUNK_STATE_GENERATED) ||
+		    a->second->getState(Chunk::CHUNK_STATE_IN_DELETING_QUEUE)) overmeshed++;
+	}
+    }
+
+    for(auto& [index, c] : chunks) delete c;
+
+    std::cout << "Edits: " << count << " over " << WORLD_CHUNKS << "x" << WORLD_CHUNKS << "x" <<
+	WORLD_CHUNKS << " chunks, " << changed << " blocks changed" << std::endl;
+    std::cout << "Read back wrong: " << wrong << " blocks, count off: " << miscounted <<
+	" edits, chunks not meshed: " << unmeshed << ", chunks meshed that can't be edited: " <<
+	overmeshed << std::endl;
+    std::cout << "Time (ms): edits " << edit_time << " (" << changed / std::max(edit_time, 1e-9) <<
+	" blocks/ms), reads " << read_time << std::endl;
+    return wrong == 0 && miscounted == 0 && unmeshed == 0 && overmeshed == 0 ? EXIT_SUCCESS :
+	EXIT_FAILURE;
+}
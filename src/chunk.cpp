@@ -1,12 +1,14 @@
 #include <iostream>
 
 #include "chunk.hpp"
+#include "chunkmeshdata.hpp"
 #include "block.hpp"
 #include "utils.hpp"
 #include "intervalmap.hpp"
 #include "globals.hpp"
 
 #include <memory>
+#include <utility>
 namespace Chunk
 {
 
@@ -24,12 +26,23 @@ namespace Chunk
 	 return i | (j << 10) | (k << 20); 
     }
 
+    int facePairBit(int a, int b){
+	if(a > b) std::swap(a, b);
+	// Pairs (a, b) with a < b, in order
+	return a * 5 - a * (a - 1) / 2 + (b - a - 1);
+    }
+
+    bool facesConnected(uint16_t connectivity, int a, int b){
+	return a == b || (connectivity & (1 << facePairBit(a, b)));
+    }
+
     Chunk::Chunk(glm::vec3 pos)
     {
         this->position = pos;
         this->setState(CHUNK_STATE_EMPTY, true);
 	this->setBlocks(0, CHUNK_MAX_INDEX, Block::AIR);
 	this->index = calculateIndex(pos);
+	for(auto& d : this->dirty_layers) d = 0;
     }
 
     Chunk ::~Chunk()
@@ -49,9 +62,61 @@ namespace Chunk
 	this->setBlocks(coord, coord+1, b);
     }
     
+    void Chunk::setBlockDirty(int x, int y, int z)
+    {
+	// A voxel touches the boundaries before and after it along each dimension
+	this->setLayerDirty(0, x);
+	this->setLayerDirty(0, x + 1);
+	this->setLayerDirty(1, y);
+	this->setLayerDirty(1, y + 1);
+	this->setLayerDirty(2, z);
+	this->setLayerDirty(2, z + 1);
+    }
+
+    void Chunk::setMeshSlices(ChunkMeshSlices* slices)
+    {
+	this->mesh_slices.reset(slices);
+    }
+    
     void Chunk::setBlocks(int start, int end, Block b){
+	start = start < 0 ? 0 : start;
+	end = end >= CHUNK_VOLUME ? CHUNK_VOLUME : end;
         if(b != Block::AIR) this->setState(CHUNK_STATE_EMPTY, false);
-        this->blocks.insert(start < 0 ? 0 : start, end >= CHUNK_VOLUME ? CHUNK_VOLUME : end, b);
+	if(!this->connectivity_dirty)
+	    this->blocks.forEachRun(start, end, [&](int, int, Block old){
+		if((old == Block::AIR) != (b == Block::AIR)) this->connectivity_dirty = true;
+	    });
+        this->blocks.insert(start, end, b);
+	std::atomic_store(&this->occupancy, std::shared_ptr<const ChunkOccupancy>());
+    }
+
+    void Chunk::setBlocksArray(Block* arr, int length){
+	for(int i = 0; i < length; i++)
+	    if(arr[i] != Block::AIR){
+		this->setState(CHUNK_STATE_EMPTY, false);
+		break;
+	    }
+	this->blocks.fromArray(arr, length);
+	this->connectivity_dirty = true;
+	std::atomic_store(&this->occupancy, std::shared_ptr<const ChunkOccupancy>());
+    }
+
+    std::shared_ptr<const ChunkOccupancy> Chunk::getOccupancy()
+    {
+	std::shared_ptr<const ChunkOccupancy> occupancy = std::atomic_load(&this->occupancy);
+	if(occupancy) return occupancy;
+
+	// Two threads might end up building it at the same time, they build the same thing
+	auto built = std::make_shared<ChunkOccupancy>();
+	this->blocks.forEachRun(0, CHUNK_VOLUME, [&](int start, int end, Block b){
+	    if(b == Block::AIR || b == Block::NULLBLK) return;
+	    for(int h = start; h < end; h++)
+		built->set(HILBERT_XYZ_DECODE[h][0] + HILBERT_XYZ_DECODE[h][1] * CHUNK_SIZE +
+			HILBERT_XYZ_DECODE[h][2] * CHUNK_SIZE * CHUNK_SIZE);
+	});
+	occupancy = built;
+	std::atomic_store(&this->occupancy, occupancy);
+	return occupancy;
     }
 
     void Chunk::setState(chunk_state_t nstate, bool value)
@@ -5,6 +5,7 @@
 #include "block.hpp"
 #include "chunkgenerator.hpp"
 #include "globals.hpp"
+#include "heightmap.hpp"
 #include "OpenSimplexNoise.h"
 #include "utils.hpp"
 
@@ -79,7 +80,7 @@ void generateNoise(Chunk::Chunk *chunk)
 	int bx = i / CHUNK_SIZE;
 	int bz = i % CHUNK_SIZE;
 
-	grassNoiseLUT[i] = GRASS_OFFSET + evaluateNoise(noiseGen1, cx+bx, cz+bz, NOISE_GRASS_MULT, 0.01, 0.35, 2.1, 5);
+	grassNoiseLUT[i] = terrainHeight(cx+bx, cz+bz);
 	dirtNoiseLUT[i] = NOISE_DIRT_MIN + (int)((1 + noiseGen2.eval(cx+bx * NOISE_DIRT_X_MULT,
 			cz+bz * NOISE_DIRT_Z_MULT)) * NOISE_DIRT_MULT);
     }
@@ -102,6 +103,9 @@ void generateNoise(Chunk::Chunk *chunk)
     // Take advantage of the interval-map structure by only inserting contigous runs of blocks
     Block block_prev{Block::AIR}, block;
     int block_prev_start{0};
+    // Highest block of each column, handed over to the heightmap
+    heightmap::ChunkHeights heights;
+    heights.fill(-1);
     for (int s = 0; s < CHUNK_VOLUME; s++)
     {
 	int bx = HILBERT_XYZ_DECODE[s][0];
@@ -168,6 +172,7 @@ void generateNoise(Chunk::Chunk *chunk)
 
 	if(wood) block = Block::WOOD;
 	if(leaf) block = Block::LEAVES;
+	if(block != Block::AIR && by > heights[lut_index]) heights[lut_index] = by;
 
 	// Use the interval-map structure of the chunk to compress the world: insert "runs" of
 	// equal blocks using indices in the hilbert curve
@@ -180,6 +185,7 @@ void generateNoise(Chunk::Chunk *chunk)
     }
     // Insert the last run of blocks
     chunk->setBlocks(block_prev_start, CHUNK_VOLUME, block_prev);
+    heightmap::setChunk(glm::ivec3(chunk->getPosition()), heights);
     // Mark the chunk as generated, is needed to trigger the next steps
     chunk->setState(Chunk::CHUNK_STATE_GENERATED, true);
 }
@@ -224,6 +230,11 @@ struct TreeCellInfo evaluateTreeCell(int wcx, int wcz){
 	return result;
 }
 
+int terrainHeight(int x, int z)
+{
+    return GRASS_OFFSET + evaluateNoise(noiseGen1, x, z, NOISE_GRASS_MULT, 0.01, 0.35, 2.1, 5);
+}
+
 void generateChunk(Chunk::Chunk *chunk)
 {
     generateNoise(chunk);
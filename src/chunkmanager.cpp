@@ -1,9 +1,13 @@
 #include "chunkmanager.hpp"
 
+#include <algorithm>
+#include <array>
 #include <atomic>
 #include <math.h>
+#include <memory>
 #include <vector>
 #include <thread>
+#include <utility>
 
 #include <glm/glm.hpp>
 #include <glm/gtx/string_cast.hpp>
@@ -15,8 +19,12 @@
 #include "chunk.hpp"
 #include "chunkgenerator.hpp"
 #include "chunkmesher.hpp"
+#include "collision.hpp"
 #include "debugwindow.hpp"
 #include "globals.hpp"
+#include "heightmap.hpp"
+#include "navigation.hpp"
+#include "raycast.hpp"
 #include "renderer.hpp"
 #include "utils.hpp"
 
@@ -26,20 +34,52 @@ namespace chunkmanager
 					 // controls.cpp)
     void generate();
     void mesh();
-    void send_to_chunk_meshing_thread(Chunk::Chunk* c, int priority);
+    void edit();
+    void update_neighbours(Chunk::Chunk* c, bool generated);
+    bool neighbours_ready(Chunk::Chunk* c, const RenderVolume& volume, int distx, int disty, int distz);
+    bool try_meshing(Chunk::Chunk* c);
 
     /* Chunk holding data structures */
     // Concurrent hash table of chunks
     ChunkTable chunks;
     // Chunk indices. Centered at (0,0,0), going in concentric sphere outwards
-    std::array<std::array<chunk_intcoord_t, 3>, chunks_volume> chunks_indices;
+    std::vector<std::array<chunk_intcoord_t, 3>> chunks_indices;
+
+    /* Render volume */
+    // Set from the debug window, applied at the start of the next update
+    std::atomic_int render_distance{RENDER_DISTANCE}, render_height{RENDER_HEIGHT},
+	render_shape{RENDER_SHAPE_CYLINDER};
+    // Volume the chunk indices were built with. Accessed with std::atomic_load and
+    // std::atomic_store
+    std::shared_ptr<const RenderVolume> render_volume;
 
     /* World Update messaging data structure */
     WorldUpdateMsgQueue WorldUpdateQueue;
 
     /* Multithreading */
     std::atomic_bool should_run;
-    std::thread gen_thread, mesh_thread, update_thread;
+    std::thread gen_thread, mesh_thread, update_thread, edit_thread;
+
+    /* Prefetching */
+    // Velocity of the player, measured over intervals of at least PREFETCH_SAMPLE_TIME seconds
+    constexpr double PREFETCH_SAMPLE_TIME = 0.1;
+    glm::vec3 velocity{0.0f}, last_position;
+    double last_sample_time{-1};
+    // Prefetched chunks that got into the render volume already generated (hits), still waiting
+    // for generation (late), or never got into it before being unloaded (wasted)
+    std::atomic_int prefetch_requested{0}, prefetch_hits{0}, prefetch_late{0}, prefetch_wasted{0};
+    std::atomic_int prefetch_pending{0};
+
+    // Set from the debug window, the update thread runs the benchmarks and clears them
+    std::atomic_bool raycast_benchmark{false}, collision_benchmark{false};
+
+    /* Job accounting */
+    // Jobs run to completion, jobs thrown away because stale, and jobs not queued because the
+    // queue was full
+    std::atomic_int generation_done{0}, generation_stale{0}, generation_deferred{0};
+    std::atomic_int meshing_done{0}, meshing_stale{0}, meshing_deferred{0};
+    // Chunks sent to meshing as soon as their last neighbour was generated
+    std::atomic_int meshing_triggered{0};
 
     // Queue of chunks to be generated
     ChunkPriorityQueue chunks_to_generate_queue;
@@ -47,25 +87,23 @@ namespace chunkmanager
     ChunkPriorityQueue chunks_to_mesh_queue;
 
     WorldUpdateMsgQueue& getWorldUpdateQueue(){ return WorldUpdateQueue; }
+    ChunkTable& getChunks(){ return chunks; }
     
     // Init chunkmanager. Chunk indices and start threads
     void init(){
-	int index{0};
-
-	for(chunk_intcoord_t i = -RENDER_DISTANCE; i < RENDER_DISTANCE; i++)
-	    for(chunk_intcoord_t j = -RENDER_DISTANCE; j < RENDER_DISTANCE; j++)
-		for(chunk_intcoord_t k = -RENDER_DISTANCE; k < RENDER_DISTANCE; k++){
+	build_chunks_indices();
 
-		    chunks_indices[index][0]=i;
-		    chunks_indices[index][1]=j;
-		    chunks_indices[index][2]=k;
-		    index++;
-		}
+	debug::window::set_parameter("render_distance_return", &render_distance);
+	debug::window::set_parameter("render_height_return", &render_height);
+	debug::window::set_parameter("render_shape_return", &render_shape);
+	debug::window::set_parameter("raycast_benchmark_return", &raycast_benchmark);
+	debug::window::set_parameter("collision_benchmark_return", &collision_benchmark);
 
 	should_run = true;
 	update_thread = std::thread(update);
 	gen_thread = std::thread(generate);
 	mesh_thread = std::thread(mesh);
+	edit_thread = std::thread(edit);
     }
 
     // Method for world generation thread(s)
@@ -73,9 +111,25 @@ namespace chunkmanager
 	while(should_run){
 	    ChunkPQEntry entry;
 	    if(chunks_to_generate_queue.try_pop(entry)){
-		Chunk::Chunk* chunk = entry.first;
-		generateChunk(chunk);
+		Chunk::Chunk* chunk = entry.chunk;
+		if(entry.priority == GENERATION_PRIORITY_PREFETCH) prefetch_pending--;
+
+		// A promoted prefetch has two jobs, the chunk might already be generated by the other
+		if(entry.ticket == chunk->getJobTicket() && !chunk->getState(Chunk::CHUNK_STATE_GENERATED)){
+		    generateChunk(chunk);
+		    update_neighbours(chunk, true);
+		    navigation::invalidate(chunk->getPosition());
+		    generation_done++;
+		}else generation_stale++;
+
+		// The chunk can only be meshed once it is out of the generation queue. Holding it
+		// keeps it from being unloaded in between, and from being promoted while the flag is
+		// cleared
+		ChunkTable::accessor a;
+		chunks.find(a, chunk->getIndex());
+		if(!chunk->finishGenerationJob()) continue;
 		chunk->setState(Chunk::CHUNK_STATE_IN_GENERATION_QUEUE, false);
+		if(try_meshing(chunk)) meshing_triggered++;
 	    }
 	}
 	chunks_to_generate_queue.clear();
@@ -86,41 +140,268 @@ namespace chunkmanager
 	while(should_run){
 	    ChunkPQEntry entry;
 	    if(chunks_to_mesh_queue.try_pop(entry)){
-		Chunk::Chunk* chunk = entry.first;
-		chunkmesher::mesh(chunk);
-		chunk->setState(Chunk::CHUNK_STATE_IN_MESHING_QUEUE, false);
+		Chunk::Chunk* chunk = entry.chunk;
+		if(entry.ticket == chunk->getJobTicket()){
+		    chunkmesher::mesh(chunk);
+		    meshing_done++;
+		}else meshing_stale++;
+
+		// Jobs are only queued by someone holding the chunk, so the flag can't be set again
+		// while it is cleared here
+		ChunkTable::accessor a;
+		chunks.find(a, chunk->getIndex());
+		if(chunk->finishMeshingJob()) chunk->setState(Chunk::CHUNK_STATE_IN_MESHING_QUEUE, false);
 	    }
 	}
 	chunks_to_mesh_queue.clear();
     }
 
-    void send_to_chunk_meshing_thread(Chunk::Chunk* c, int priority){
+    void build_chunks_indices(){
+	const auto next = std::make_shared<RenderVolume>(RenderVolume{std::max(render_distance.load(),
+		    1), std::max(render_height.load(), 1), render_shape});
+
+	chunks_indices.clear();
+	for(chunk_intcoord_t i = -next->distance; i <= next->distance; i++)
+	    for(chunk_intcoord_t j = -next->height; j <= next->height; j++)
+		for(chunk_intcoord_t k = -next->distance; k <= next->distance; k++)
+		    if(next->contains(i, j, k)) chunks_indices.push_back({i, j, k});
+
+	// Nearest first, so that chunks around the player are created (and then generated) first
+	std::sort(chunks_indices.begin(), chunks_indices.end(), [](const auto& u, const auto& v){
+		return u[0] * u[0] + u[1] * u[1] + u[2] * u[2] < v[0] * v[0] + v[1] * v[1] + v[2] * v[2];
+		});
+
+	std::atomic_store(&render_volume, std::shared_ptr<const RenderVolume>(next));
+    }
+
+    bool RenderVolume::contains(int dx, int dy, int dz) const{
+	const int d = distance, h = height;
+	if(std::abs(dx) > d || std::abs(dy) > h || std::abs(dz) > d) return false;
+
+	switch(shape){
+	    case RENDER_SHAPE_CYLINDER:
+		return dx * dx + dz * dz <= d * d;
+	    case RENDER_SHAPE_SPHERE:
+		// Squashed vertically when the height is smaller than the distance
+		return static_cast<float>(dx * dx + dz * dz) / (d * d) + static_cast<float>(dy * dy) / (h *
+			h) <= 1.0f;
+	    default:
+		return true;
+	}
+    }
+
+    bool inRenderVolume(int dx, int dy, int dz){ return getRenderVolume()->contains(dx, dy, dz); }
+
+    std::shared_ptr<const RenderVolume> getRenderVolume(){ return std::atomic_load(&render_volume); }
+
+    // Method for the player edits thread. Edits are applied as soon as they come in, instead of
+    // waiting for the update loop to go around
+    void edit(){
+	while(should_run){
+	    WorldUpdateMsg msg;
+	    try{
+		WorldUpdateQueue.pop(msg);
+	    }catch(const oneapi::tbb::user_abort& e){
+		// Shutting down
+		break;
+	    }
+
+	    switch(msg.msg_type){
+		case WorldUpdateMsgType::BLOCKPICK_BREAK:
+		case WorldUpdateMsgType::BLOCKPICK_PLACE:
+		    blockpick(msg);
+		    break;
+	    }
+
+	    // From the click to the remeshes being queued. The rest of the latency, up to the new
+	    // mesh being uploaded, is measured by the renderer
+	    debug::window::set_parameter("edit_latency_apply", (float)((glfwGetTime() - msg.time) *
+			1000.0));
+	}
+    }
+
+    // Both return false if the job was not queued because the queue is full. Meshing jobs must be
+    // sent while holding the chunk in the chunk table, so that checking whether the chunk is free
+    // and queueing it happen in one go
+    bool send_to_chunk_generation_thread(Chunk::Chunk* c, int priority){
+	if(chunks_to_generate_queue.size() >= GENERATION_QUEUE_LIMIT){
+	    generation_deferred++;
+	    return false;
+	}
+
+	// Mark as present in the queue before sending to avoid strange
+	// a chunk being marked as in the queue after it was already
+	// processed
+	c->addGenerationJob();
+	c->setState(Chunk::CHUNK_STATE_IN_GENERATION_QUEUE, true);
+	chunks_to_generate_queue.push({c, static_cast<uint8_t>(priority), c->getJobTicket()});
+	return true;
+    }
+
+    bool send_to_chunk_meshing_thread(Chunk::Chunk* c, int priority){
+	if(priority < MESHING_PRIORITY_PLAYER_EDIT && chunks_to_mesh_queue.size() >= MESHING_QUEUE_LIMIT){
+	    meshing_deferred++;
+	    return false;
+	}
+
+	c->addMeshingJob();
 	c->setState(Chunk::CHUNK_STATE_IN_MESHING_QUEUE, true);
-	chunks_to_mesh_queue.push(std::make_pair(c, MESHING_PRIORITY_NORMAL));
+	chunks_to_mesh_queue.push({c, static_cast<uint8_t>(priority), c->getJobTicket()});
+	return true;
+    }
+
+    // Offset of the neighbour across each face, faces numbered as in chunk.hpp
+    static const glm::ivec3 neighbour_offsets[6]{
+	{-1, 0, 0}, {1, 0, 0}, {0, -1, 0}, {0, 1, 0}, {0, 0, -1}, {0, 0, 1}
+    };
+
+    // Keep the neighbour masks of c and of the chunks around it in sync with c having been
+    // generated or going away. Neighbours that become ready to mesh because of it are sent right
+    // away, instead of waiting for the update loop to notice. c itself is still in the generation
+    // queue, generate() sends it once it is out
+    void update_neighbours(Chunk::Chunk* c, bool generated){
+	const glm::ivec3 pos = c->getPosition();
+	for(int face = 0; face < 6; face++){
+	    const glm::ivec3 n = pos + neighbour_offsets[face];
+	    if(n.x < 0 || n.y < 0 || n.z < 0 || n.x > 1023 || n.y > 1023 || n.z > 1023) continue;
+
+	    // The accessor keeps the neighbour from being deleted while it is used, and from being
+	    // queued for meshing by the update loop at the same time
+	    ChunkTable::accessor a;
+	    if(!chunks.find(a, Chunk::calculateIndex(n.x, n.y, n.z))) continue;
+	    Chunk::Chunk* neighbour = a->second;
+
+	    // The neighbour sees c across the opposite face
+	    neighbour->setNeighbour(face ^ 1, generated);
+	    if(!generated) continue;
+
+	    if(neighbour->getState(Chunk::CHUNK_STATE_GENERATED)){
+		c->setNeighbour(face, true);
+		if(try_meshing(neighbour)) meshing_triggered++;
+	    }
+	}
+    }
+
+    // A neighbour is needed only if it can be there: not past the world border, and inside the
+    // render volume
+    bool neighbours_ready(Chunk::Chunk* c, const RenderVolume& volume, int distx, int disty, int distz){
+	const glm::ivec3 pos = c->getPosition();
+	const glm::ivec3 dist(distx, disty, distz);
+	uint8_t needed{0};
+	for(int face = 0; face < 6; face++){
+	    const glm::ivec3 n = pos + neighbour_offsets[face];
+	    const glm::ivec3 d = dist + neighbour_offsets[face];
+	    if(n.x < 0 || n.y < 0 || n.z < 0 || n.x > 1023 || n.y > 1023 || n.z > 1023) continue;
+	    if(!volume.contains(d.x, d.y, d.z)) continue;
+	    needed |= 1 << face;
+	}
+	return (c->getNeighbours() & needed) == needed;
+    }
+
+    // Called from the generation thread while holding c, so the position of the player is read
+    // again
+    bool try_meshing(Chunk::Chunk* c){
+	if(!c->getState(Chunk::CHUNK_STATE_GENERATED) || c->getState(Chunk::CHUNK_STATE_MESHED) ||
+		!c->isFree()) return false;
+
+	const glm::ivec3 dist = glm::ivec3(c->getPosition()) - glm::ivec3(
+		static_cast<int>(theCamera.getAtomicPosX() / CHUNK_SIZE),
+		static_cast<int>(theCamera.getAtomicPosY() / CHUNK_SIZE),
+		static_cast<int>(theCamera.getAtomicPosZ() / CHUNK_SIZE));
+	const auto volume = getRenderVolume();
+	if(!volume->contains(dist.x, dist.y, dist.z) || !neighbours_ready(c, *volume, dist.x, dist.y,
+		    dist.z))
+	    return false;
+
+	const int old_lod = c->getLod();
+	c->setLod(lodForDistance(std::max({std::abs(dist.x), std::abs(dist.y), std::abs(dist.z)}),
+		    old_lod));
+	if(send_to_chunk_meshing_thread(c, MESHING_PRIORITY_NORMAL)) return true;
+	c->setLod(old_lod);
+	return false;
+    }
+
+    // Speculatively create and generate chunks around where the player is going to be, so that
+    // they are ready by the time they get into the render volume. The position is extrapolated
+    // from the velocity, and only chunks ahead of the player (where they are moving or looking)
+    // that the current volume doesn't already cover are considered, nearest to the predicted
+    // position first. Prefetched chunks that are never reached are unloaded like any other chunk
+    // left outside the render volume
+    void prefetch(glm::vec3 position, glm::ivec3 chunk){
+	const double now = glfwGetTime();
+	if(last_sample_time < 0 || now - last_sample_time >= PREFETCH_SAMPLE_TIME){
+	    if(last_sample_time >= 0)
+		velocity = glm::mix(velocity, (position - last_position) / static_cast<float>(now -
+			    last_sample_time), 0.5f);
+	    last_position = position;
+	    last_sample_time = now;
+	}
+
+	const float speed = glm::length(velocity);
+	if(speed < PREFETCH_MIN_SPEED || prefetch_pending >= PREFETCH_MAX_PENDING) return;
+
+	const glm::vec3 heading = velocity / speed;
+	const glm::vec3 front = theCamera.getAtomicFront();
+	const glm::ivec3 predicted = glm::floor((position + velocity * PREFETCH_LOOKAHEAD) /
+		static_cast<float>(CHUNK_SIZE));
+
+	const auto volume = getRenderVolume();
+	int created{0};
+	for(const auto& offset : chunks_indices){
+	    if(created >= PREFETCH_MAX_PER_UPDATE || prefetch_pending >= PREFETCH_MAX_PENDING) break;
+
+	    const glm::ivec3 c = predicted + glm::ivec3(offset[0], offset[1], offset[2]);
+	    const glm::ivec3 d = c - chunk;
+	    if(volume->contains(d.x, d.y, d.z)) continue;
+	    if(glm::dot(glm::vec3(d), heading) <= 0 && glm::dot(glm::vec3(d), front) <= 0) continue;
+	    if(c.x < 0 || c.y < 0 || c.z < 0 || c.x > 1023 || c.y > 1023 || c.z > 1023) continue;
+
+	    const chunk_index_t index = Chunk::calculateIndex(c.x, c.y, c.z);
+	    ChunkTable::accessor a;
+	    if(chunks.find(a, index)) continue;
+
+	    Chunk::Chunk* prefetched = new Chunk::Chunk(glm::vec3(c));
+	    prefetched->setState(Chunk::CHUNK_STATE_PREFETCHED, true);
+	    chunks.emplace(a, std::make_pair(index, prefetched));
+	    // Left there, it will be generated by the update loop if the player gets to it
+	    if(!send_to_chunk_generation_thread(prefetched, GENERATION_PRIORITY_PREFETCH)) break;
+
+	    prefetch_pending++;
+	    prefetch_requested++;
+	    created++;
+	}
+    }
+
+    int lodForDistance(int distance, int current){
+	static const int lod_distances[LOD_LEVELS]{0, LOD1_DISTANCE, LOD2_DISTANCE, LOD3_DISTANCE};
+
+	int lod{0};
+	while(lod < LOD_LEVELS - 1 && distance >= lod_distances[lod + 1]) lod++;
+	// Avoid chunks right on the boundary between two levels flipping back and forth
+	if(lod < current && distance >= lod_distances[current] - LOD_HYSTERESIS) return current;
+	return lod;
     }
 
+
     oneapi::tbb::concurrent_queue<chunk_index_t> chunks_todelete;
     void update(){
 	while(should_run) {
 	    /* Setup variables for the whole loop */
 	    // Atomic is needed by parallel_for
-	    std::atomic_int nUnloaded{0}, nMarkUnload{0}, nExplored{0}, nMeshed{0}, nGenerated{0};
+	    std::atomic_int nUnloaded{0}, nMarkUnload{0}, nExplored{0}, nMeshed{0}, nGenerated{0}, nLodSwitches{0};
 	    std::atomic_int chunkX=static_cast<int>(theCamera.getAtomicPosX() / CHUNK_SIZE);
 	    std::atomic_int chunkY=static_cast<int>(theCamera.getAtomicPosY() / CHUNK_SIZE);
 	    std::atomic_int chunkZ=static_cast<int>(theCamera.getAtomicPosZ() / CHUNK_SIZE);
 
-	    /* Process update messages before anything happens */
-	    WorldUpdateMsg msg;
-	    while(WorldUpdateQueue.try_pop(msg)){
-		switch(msg.msg_type){
-		    case WorldUpdateMsgType::BLOCKPICK_BREAK:
-		    case WorldUpdateMsgType::BLOCKPICK_PLACE:
-			blockpick(msg);
-			break;
-		}
+	    /* Apply changes to the render volume */
+	    // Chunks that end up outside are unloaded by the usual timeout
+	    std::shared_ptr<const RenderVolume> volume = getRenderVolume();
+	    if(std::max(render_distance.load(), 1) != volume->distance || std::max(render_height.load(),
+			1) != volume->height || render_shape != volume->shape){
+		build_chunks_indices();
+		volume = getRenderVolume();
 	    }
 
-
 	    /* Delete old chunks */
 	    // In my head it makes sense to first delete old chunks, then create new ones
 	    // I think it's easier for memory allocator to re-use the memory that was freed just
@@ -132,10 +413,22 @@ namespace chunkmanager
 		const chunk_index_t index = i;
 		if(chunks.find(a, index)){
 		    Chunk::Chunk* c = a->second;
+		    // A job might have been queued for the chunk after it was marked, it is tried
+		    // again once the chunk is free
+		    if(c->getState(Chunk::CHUNK_STATE_IN_GENERATION_QUEUE) ||
+			    c->getState(Chunk::CHUNK_STATE_IN_MESHING_QUEUE)){
+			c->setState(Chunk::CHUNK_STATE_IN_DELETING_QUEUE, false);
+			a.release();
+			continue;
+		    }
 		    // Use the accessor to erase the element
 		    // Using the key doesn't work
 		    if(chunks.erase(a)){
+			update_neighbours(c, false);
+			heightmap::removeChunk(c->getPosition());
+			navigation::invalidate(c->getPosition());
 			nUnloaded++;
+			if(c->getState(Chunk::CHUNK_STATE_PREFETCHED)) prefetch_wasted++;
 			renderer::getDeleteIndexQueue().push(index);
 			delete c;
 		    } else {
@@ -146,10 +439,10 @@ namespace chunkmanager
 	    }
 
 	    /* Create new chunks around the player */
-	    for(int i = 0; i < chunks_volume; i++) {
-		const chunk_intcoord_t x = chunks_indices[i][0] + chunkX;
-		const chunk_intcoord_t y = chunks_indices[i][1] + chunkY;
-		const chunk_intcoord_t z = chunks_indices[i][2] + chunkZ;
+	    for(const auto& offset : chunks_indices) {
+		const chunk_intcoord_t x = offset[0] + chunkX;
+		const chunk_intcoord_t y = offset[1] + chunkY;
+		const chunk_intcoord_t z = offset[2] + chunkZ;
 
 		if(x < 0 || y < 0 || z < 0 || x > 1023 || y > 1023 || z > 1023) continue;
 		nExplored++;
@@ -160,6 +453,10 @@ namespace chunkmanager
 			    Chunk::Chunk(glm::vec3(x,y,z))));
 	    }
 
+	    /* Prefetch chunks ahead of the player */
+	    prefetch(glm::vec3(theCamera.getAtomicPosX(), theCamera.getAtomicPosY(),
+			theCamera.getAtomicPosZ()), glm::ivec3(chunkX.load(), chunkY.load(), chunkZ.load()));
+
 	    /* Update all the chunks */
 	    oneapi::tbb::parallel_for(chunks.range(), [&](ChunkTable::range_type &r){
 		for(ChunkTable::iterator a = r.begin(); a != r.end(); a++){
@@ -173,15 +470,34 @@ namespace chunkmanager
 		    int distz = z - chunkZ;
 
 		    // Local variables avoid continously having to call atomic variables
-		    int gen{0}, mesh{0}, unload{0};
+		    int gen{0}, mesh{0}, unload{0}, lod_switch{0};
+		    const int lod = lodForDistance(std::max({std::abs(distx), std::abs(disty),
+				std::abs(distz)}), c->getLod());
 
-		    if(
-			    distx >= -RENDER_DISTANCE && distx < RENDER_DISTANCE &&
-			    disty >= -RENDER_DISTANCE && disty < RENDER_DISTANCE &&
-			    distz >= -RENDER_DISTANCE && distz < RENDER_DISTANCE
-		      ){
+		    if(volume->contains(distx, disty, distz)){
 
 			// If within distance
+			// The player got here, was prefetching worth it?
+			if(c->getState(Chunk::CHUNK_STATE_PREFETCHED)){
+			    c->setState(Chunk::CHUNK_STATE_PREFETCHED, false);
+			    if(c->getState(Chunk::CHUNK_STATE_GENERATED)) prefetch_hits++;
+			    else{
+				prefetch_late++;
+
+				// Still queued at prefetch priority, behind every normal job, and the player
+				// is right here. Queue it again at normal priority, the old job goes stale
+				// and is still counted in prefetch_pending until it comes out of the queue.
+				// If the queue is full, the stale job clears the way for the update loop
+				ChunkTable::accessor pa;
+				chunks.find(pa, c->getIndex());
+				if(c->getState(Chunk::CHUNK_STATE_IN_GENERATION_QUEUE) &&
+					!c->getState(Chunk::CHUNK_STATE_GENERATED)){
+				    c->cancelJobs();
+				    send_to_chunk_generation_thread(c, GENERATION_PRIORITY_NORMAL);
+				}
+			    }
+			}
+
 			// Reset out-of-view flags
 			c->setState(Chunk::CHUNK_STATE_OUTOFVISION, false);
 			c->setState(Chunk::CHUNK_STATE_UNLOADED, false);
@@ -191,43 +507,43 @@ namespace chunkmanager
 			    if(c->isFree()){
 				// Generate
 
-				// Mark as present in the queue before sending to avoid strange
-				// a chunk being marked as in the queue after it was already
-				// processed
-				c->setState(Chunk::CHUNK_STATE_IN_GENERATION_QUEUE, true);
-				chunks_to_generate_queue.push(std::make_pair(c, GENERATION_PRIORITY_NORMAL));
+				send_to_chunk_generation_thread(c, GENERATION_PRIORITY_NORMAL);
 			    }
 			}else{
 			    gen++;
+			    // Hold the chunk while deciding whether to queue it, the generation thread might
+			    // be trying to queue it too
+			    ChunkTable::accessor ma;
+			    chunks.find(ma, c->getIndex());
+
 			    // If generated but not yet meshed
 			    if(!c->getState(Chunk::CHUNK_STATE_MESHED)){
-				ChunkTable::accessor a1;
-
 				// Checking if nearby chunks have been generated allows for seamless
-				// borders between chunks
-				if(c->isFree() &&
-				    (distx+1 >= RENDER_DISTANCE || x + 1 > 1023 || (chunks.find(a1, Chunk::calculateIndex(x+1, y, z)) &&
-					a1->second->getState(Chunk::CHUNK_STATE_GENERATED))) &&
-				    (distx-1 < -RENDER_DISTANCE || x - 1 < 0 || (chunks.find(a1, Chunk::calculateIndex(x-1, y, z)) &&
-					a1->second->getState(Chunk::CHUNK_STATE_GENERATED))) &&
-				    (disty+1 >= RENDER_DISTANCE || y + 1 > 1023 || (chunks.find(a1, Chunk::calculateIndex(x, y+1, z)) &&
-					a1->second->getState(Chunk::CHUNK_STATE_GENERATED))) &&
-				    (disty-1 < -RENDER_DISTANCE || y - 1 < 0|| (chunks.find(a1, Chunk::calculateIndex(x, y-1, z)) &&
-					a1->second->getState(Chunk::CHUNK_STATE_GENERATED))) &&
-				    (distz+1 >= RENDER_DISTANCE || z + 1 > 1023 || (chunks.find(a1, Chunk::calculateIndex(x, y, z+1)) &&
-					a1->second->getState(Chunk::CHUNK_STATE_GENERATED))) &&
-				    (distz-1 < -RENDER_DISTANCE || z - 1 < 0|| (chunks.find(a1, Chunk::calculateIndex(x, y, z-1)) &&
-					a1->second->getState(Chunk::CHUNK_STATE_GENERATED)))
-				  )
+				// borders between chunks. Usually the generation thread already sent the
+				// chunk when its last neighbour was done, this catches the chunks that
+				// became ready because the render volume moved, or that found the queue
+				// full
+				if(c->isFree() && neighbours_ready(c, *volume, distx, disty, distz))
 				{
 				    // Mesh
-
-				    // Mark as present in the queue before sending to avoid strange
-				    // a chunk being marked as in the queue after it was already
-				    // processed
+				    c->setLod(lod);
 				    send_to_chunk_meshing_thread(c, MESHING_PRIORITY_NORMAL);
 				}
-			    }else mesh++;
+			    }else{
+				mesh++;
+
+				// Level of detail changed, mesh again. The old mesh stays on screen until
+				// the new one replaces it. Compared against the mesh that was actually
+				// built, a switch whose job was dropped as stale is tried again
+				if(lod != c->getMeshLod() && c->isFree()){
+				    // Set before queueing, the mesher reads it. Put back if the queue is
+				    // full, so that the switch is tried again at the next update
+				    const int old_lod = c->getLod();
+				    c->setLod(lod);
+				    if(send_to_chunk_meshing_thread(c, MESHING_PRIORITY_NORMAL)) lod_switch++;
+				    else c->setLod(old_lod);
+				}
+			    }
 			}
 
 		    }else{
@@ -241,6 +557,9 @@ namespace chunkmanager
 			    }
 			}else{
 			    // Mark as out of view, and start waiting time
+			    // Whatever is still queued for the chunk is not needed anymore. Prefetched
+			    // chunks are outside on purpose, they are left alone
+			    if(!c->getState(Chunk::CHUNK_STATE_PREFETCHED)) c->cancelJobs();
 			    c->setState(Chunk::CHUNK_STATE_OUTOFVISION, true);
 			    c->setState(Chunk::CHUNK_STATE_UNLOADED, false);
 			    c->unload_timer = glfwGetTime();
@@ -251,6 +570,7 @@ namespace chunkmanager
 		    nGenerated += gen;
 		    nMeshed += mesh;
 		    nMarkUnload += unload;
+		    nLodSwitches += lod_switch;
 		}
 	    });
 
@@ -259,13 +579,47 @@ namespace chunkmanager
 	    debug::window::set_parameter("update_chunks_meshed", (int) nMeshed);
 	    debug::window::set_parameter("update_chunks_freed", (int) nUnloaded);
 	    debug::window::set_parameter("update_chunks_explored", (int) nExplored);
+	    debug::window::set_parameter("update_chunks_volume", (int) chunks_indices.size());
+	    debug::window::set_parameter("jobs_generation_done", (int) generation_done);
+	    debug::window::set_parameter("jobs_generation_stale", (int) generation_stale);
+	    debug::window::set_parameter("jobs_generation_deferred", (int) generation_deferred);
+	    debug::window::set_parameter("jobs_generation_queued", (int) chunks_to_generate_queue.size());
+	    debug::window::set_parameter("jobs_meshing_done", (int) meshing_done);
+	    debug::window::set_parameter("jobs_meshing_stale", (int) meshing_stale);
+	    debug::window::set_parameter("jobs_meshing_deferred", (int) meshing_deferred);
+	    debug::window::set_parameter("jobs_meshing_queued", (int) chunks_to_mesh_queue.size());
+	    debug::window::set_parameter("jobs_meshing_triggered", (int) meshing_triggered);
+	    debug::window::set_parameter("prefetch_requested", (int) prefetch_requested);
+	    debug::window::set_parameter("prefetch_pending", (int) prefetch_pending);
+	    debug::window::set_parameter("prefetch_hits", (int) prefetch_hits);
+	    debug::window::set_parameter("prefetch_late", (int) prefetch_late);
+	    debug::window::set_parameter("prefetch_wasted", (int) prefetch_wasted);
+	    debug::window::set_parameter("update_chunks_lod_switches", (int) nLodSwitches);
+
+	    /* Raycast benchmark, requested from the debug window */
+	    if(raycast_benchmark.exchange(false)){
+		const double rate = raycast::benchmark(glm::vec3(theCamera.getAtomicPosX(),
+			    theCamera.getAtomicPosY(), theCamera.getAtomicPosZ()), RAYCAST_BENCHMARK_RAYS,
+			RAYCAST_BENCHMARK_DISTANCE);
+		debug::window::set_parameter("raycast_benchmark_rate", (float) rate);
+	    }
+	    if(collision_benchmark.exchange(false)){
+		const double rate = collision::benchmark(glm::vec3(theCamera.getAtomicPosX(),
+			    theCamera.getAtomicPosY(), theCamera.getAtomicPosZ()),
+			COLLISION_BENCHMARK_ENTITIES, COLLISION_BENCHMARK_STEPS);
+		debug::window::set_parameter("collision_benchmark_rate", (float) rate);
+	    }
 	}
     }
 
-    std::array<std::array<chunk_intcoord_t, 3>, chunks_volume>& getChunksIndices(){ return chunks_indices; }
+    std::vector<std::array<chunk_intcoord_t, 3>>& getChunksIndices(){ return chunks_indices; }
 
     void stop() {
 	should_run=false;
+	// The mesher might be waiting for the renderer to give back some mesh data
+	chunkmesher::stop();
+	// The edit thread might be waiting for a message
+	WorldUpdateQueue.abort();
 
 	std::cout << "Waiting for secondary threads to shut down" << std::endl;
 	update_thread.join();
@@ -274,6 +628,8 @@ namespace chunkmanager
 	std::cout << "Generation thread has terminated" << std::endl;
 	mesh_thread.join();
 	std::cout << "Meshing thread has terminated" << std::endl;
+	edit_thread.join();
+	std::cout << "Edit thread has terminated" << std::endl;
     }
 
     void destroy(){
@@ -284,208 +640,79 @@ namespace chunkmanager
     }
 
 
-    glm::vec3 ray_intersect(glm::vec3 startposition, glm::vec3 startdir){
-	int old_bx{0}, old_by{0}, old_bz{0};
-	int old_px{0}, old_py{0}, old_pz{0};
-	Chunk::Chunk* old_chunk{nullptr};
-	glm::vec3 old_pos;
-
-	// cast a ray from the camera in the direction pointed by the camera itself
-	glm::vec3 origin = startposition;
-	glm::vec3 pos = origin;
-	glm::vec3 front = startdir;
-	for(float t = 0.0; t <= 10.0; t += 0.5){
-	    // traverse the ray a block at the time
-	    pos = origin + t*front;
-
-	    // get which chunk and block the ray is at
-	    int px = ((int)(pos.x))/CHUNK_SIZE;
-	    int py = ((int)(pos.y))/CHUNK_SIZE;
-	    int pz = ((int)(pos.z))/CHUNK_SIZE;
-	    int bx = pos.x - px*CHUNK_SIZE;
-	    int by = pos.y - py*CHUNK_SIZE;
-	    int bz = pos.z - pz*CHUNK_SIZE;
-
-	    if(bx == old_bx && by == old_by && bz == old_bz) continue;
-
-	    // exit early if the position is invalid or the chunk does not exist
-	    if(px < 0 || py < 0 || pz < 0 || px >= 1024 || py >= 1024 || pz >= 1024) continue;
-
-	    ChunkTable::const_accessor a;
-	    if(!chunks.find(a, Chunk::calculateIndex(px, py, pz))) continue;
-	    Chunk::Chunk* c = a->second;
-	    if(!c->isFree() || !c->getState(Chunk::CHUNK_STATE_GENERATED)){
-		a.release();
-		continue;
-	    }
-
-	    Block b = c->getBlock(bx, by, bz);
-	    a.release();
-	    
-	    // if the block is non empty
-	    if(b != Block::AIR) return pos;
-
-	    old_chunk = c;
-	    old_bx = bx;
-	    old_by = by;
-	    old_bz = bz;
-	    old_px = px;
-	    old_py = py;
-	    old_pz = pz;
-	    old_pos = pos;
-
-	}
-	return glm::vec3(-1);
-    }
-
     void blockpick(WorldUpdateMsg& msg){
-	//std::cout << glm::to_string(ray_intersect(msg.cameraPos, msg.cameraFront)) << std::endl;
-	glm::vec3 ray_pos = ray_intersect(msg.cameraPos, msg.cameraFront);
-	if(ray_pos == glm::vec3(-1)) return;
+	const raycast::RayHit hit = raycast::cast(msg.cameraPos, msg.cameraFront, BLOCKPICK_REACH);
+	if(!hit.hit) return;
+
+	// Breaking removes the block that was hit, placing puts a new block against the face that was
+	// hit. Placing from inside a block does nothing
+	const bool place = msg.msg_type == WorldUpdateMsgType::BLOCKPICK_PLACE;
+	if(place && hit.normal == glm::ivec3(0)) return;
+	const glm::ivec3 target = place ? hit.block + hit.normal : hit.block;
+	if(glm::any(glm::lessThan(target, glm::ivec3(0))) || glm::any(glm::greaterThanEqual(target,
+			glm::ivec3(1024 * CHUNK_SIZE)))) return;
 
 	// Chunk in which the blockpick is happening
-	int chunkx = (int)(ray_pos.x) / CHUNK_SIZE;
-	int chunky = (int)(ray_pos.y) / CHUNK_SIZE;
-	int chunkz = (int)(ray_pos.z) / CHUNK_SIZE;
+	int chunkx = target.x / CHUNK_SIZE;
+	int chunky = target.y / CHUNK_SIZE;
+	int chunkz = target.z / CHUNK_SIZE;
 	// Block (chunk coord) in which the blockpick is happening
-	int blockx = ray_pos.x - chunkx*CHUNK_SIZE;
-	int blocky = ray_pos.y - chunky*CHUNK_SIZE;
-	int blockz = ray_pos.z - chunkz*CHUNK_SIZE;
+	int blockx = target.x - chunkx*CHUNK_SIZE;
+	int blocky = target.y - chunky*CHUNK_SIZE;
+	int blockz = target.z - chunkz*CHUNK_SIZE;
 
-	// The chunk must exist, otherwise ray_intersect would have returned an error
-	// Also, the block must be different from AIR
-	
 	ChunkTable::accessor a;
 	if(!chunks.find(a, Chunk::calculateIndex(chunkx, chunky, chunkz))) return;
 	Chunk::Chunk* c = a->second;
-	if(!(c->isFree() && c->getState(Chunk::CHUNK_STATE_GENERATED))) return;
-
-	if(msg.msg_type == WorldUpdateMsgType::BLOCKPICK_BREAK){
-	    c->setBlock(Block::AIR, blockx, blocky, blockz);
-	    send_to_chunk_meshing_thread(c, MESHING_PRIORITY_PLAYER_EDIT);
-	}else{
-	    // Traverse voxel using Amanatides&Woo traversal algorithm
-	    // http://www.cse.yorku.ca/~amana/research/grid.pdf
-
-	    glm::vec3 pos = msg.cameraPos;
-	    glm::vec3 front = glm::normalize(pos - ray_pos);
-
-	    // Original chunk in which the blockpick started
-	    const int ochunkX=chunkx, ochunkY = chunky, ochunkZ = chunkz;
-
-	    // The ray has equation pos + t*front
-
-	    // Initialize phase
-	    // Origin integer voxel coordinates
-	    // Avoid floating point accuracy errors: work as close to 0 as possible, translate
-	    // everything later
-	    int basex = std::floor(ray_pos.x);
-	    int basey = std::floor(ray_pos.y);
-	    int basez = std::floor(ray_pos.z);
-	    double x = ray_pos.x - basex;
-	    double y = ray_pos.y - basey;
-	    double z = ray_pos.z - basez;
-
-	    auto sign = [=](double f){ return f > 0 ? 1 : f < 0 ? -1 : 0; };
-	    auto tmax = [=](double p, double dir){
-		int s = sign(dir);
-
-		if(s > 0)
-		    return (1 - p) / dir;
-		else if(s < 0)
-		    return -(p) / dir;
-		return 0.0;
-	    };
-
-
-	    // Step
-	    int stepX = sign(front.x);
-	    int stepY = sign(front.y);
-	    int stepZ = sign(front.z);
-
-	    // tMax: the value of t at which the ray crosses the first voxel boundary
-	    double tMaxX = tmax(x, front.x);
-	    double tMaxY = tmax(y, front.y);
-	    double tMaxZ = tmax(z, front.z);
-
-	    // tDelta: how far along the ray along they ray (in units of t) for the _ component of such
-	    // a movement to equal the width of a voxel
-	    double tDeltaX = stepX / front.x;
-	    double tDeltaY = stepY / front.y;
-	    double tDeltaZ = stepZ / front.z;
-
-	    for(int i = 0; i < 10; i++){
-		if(tMaxX < tMaxY){
-		    if(tMaxX < tMaxZ) {
-			x += stepX;
-			tMaxX += tDeltaX;
-		    }else{
-			z += stepZ;
-			tMaxZ += tDeltaZ;
-		    }
-		}else{
-		    if(tMaxY < tMaxZ){
-			y += stepY;
-			tMaxY += tDeltaY;
-		    }else{
-			z += stepZ;
-			tMaxZ += tDeltaZ;
-		    }
-		}
-
-		int realx = basex + x;
-		int realy = basey + y;
-		int realz = basez + z;
-
-		chunkx = realx / CHUNK_SIZE;
-		chunky = realy / CHUNK_SIZE;
-		chunkz = realz / CHUNK_SIZE;
-
-		if(chunkx < 0 || chunky < 0 || chunkz < 0 || chunkx > 1023 || chunky > 1023 ||
-			chunkz > 1023) continue;
-
-		blockx = realx - chunkx*CHUNK_SIZE;
-		blocky = realy - chunky*CHUNK_SIZE;
-		blockz = realz - chunkz*CHUNK_SIZE;
-
-
-		Chunk::Chunk* chunk;
-		ChunkTable::accessor b;
-
-		if(chunkx != ochunkX || chunky != ochunkY || chunkz != ochunkZ){
-		    if(!chunks.find(b, Chunk::calculateIndex(chunkx, chunky, chunkz)))
-			continue;
-		    chunk = b->second;
-		    if(!(chunk->isFree() && chunk->getState(Chunk::CHUNK_STATE_GENERATED)))
-			continue;
-
-		}else{
-		    chunk = c;
-		}
-
-		if(chunk->getBlock(blockx, blocky, blockz) != Block::AIR) continue;
-		chunk->setBlock(msg.block, blockx, blocky, blockz);
-		send_to_chunk_meshing_thread(chunk, MESHING_PRIORITY_PLAYER_EDIT);
-		break;
-	    }
-	}
+	// A mesh already queued for the chunk doesn't matter, the mesher copies the blocks under the
+	// chunk accessor and the edit queues a new one behind it
+	if(!c->getState(Chunk::CHUNK_STATE_GENERATED) || c->getState(Chunk::CHUNK_STATE_IN_DELETING_QUEUE))
+	    return;
+	if(place && c->getBlock(blockx, blocky, blockz) != Block::AIR) return;
+
+	c->setBlock(place ? msg.block : Block::AIR, blockx, blocky, blockz);
+	heightmap::setBlock(c, blockx, blocky, blockz, place ? msg.block : Block::AIR);
+	c->setBlockDirty(blockx, blocky, blockz);
+	c->markEdited(msg.time);
+	send_to_chunk_meshing_thread(c, MESHING_PRIORITY_PLAYER_EDIT);
 
 	// Release the chunk in which the blockpick started to avoid locks
 	a.release();
-	 // When necessary, also mesh nearby chunks
+	 // When necessary, also mesh nearby chunks. Only the layer on the border with the edited chunk
+	 // needs to be meshed again
 	ChunkTable::accessor a1, a2, b1, b2, c1, c2;
-	if(blockx == 0 && chunkx - 1 >= 0 && chunks.find(a1, Chunk::calculateIndex(chunkx - 1, chunky, chunkz)))
+	if(blockx == 0 && chunkx - 1 >= 0 && chunks.find(a1, Chunk::calculateIndex(chunkx - 1, chunky, chunkz))){
+	  a1->second->setLayerDirty(0, CHUNK_SIZE);
+	  a1->second->markEdited(msg.time);
 	  send_to_chunk_meshing_thread(a1->second, MESHING_PRIORITY_PLAYER_EDIT);
-	if(blocky == 0 && chunky - 1 >= 0 && chunks.find(b1, Chunk::calculateIndex(chunkx, chunky - 1, chunkz)))
+	}
+	if(blocky == 0 && chunky - 1 >= 0 && chunks.find(b1, Chunk::calculateIndex(chunkx, chunky - 1, chunkz))){
+	  b1->second->setLayerDirty(1, CHUNK_SIZE);
+	  b1->second->markEdited(msg.time);
 	  send_to_chunk_meshing_thread(b1->second, MESHING_PRIORITY_PLAYER_EDIT);
-	if(blockz == 0 && chunkz - 1 >= 0 && chunks.find(c1, Chunk::calculateIndex(chunkx, chunky, chunkz - 1)))
+	}
+	if(blockz == 0 && chunkz - 1 >= 0 && chunks.find(c1, Chunk::calculateIndex(chunkx, chunky, chunkz - 1))){
+	  c1->second->setLayerDirty(2, CHUNK_SIZE);
+	  c1->second->markEdited(msg.time);
 	  send_to_chunk_meshing_thread(c1->second, MESHING_PRIORITY_PLAYER_EDIT);
-	if(blockx == CHUNK_SIZE - 1 && chunkx +1 < 1024 && chunks.find(a2, Chunk::calculateIndex(chunkx +1, chunky, chunkz)))
+	}
+	if(blockx == CHUNK_SIZE - 1 && chunkx +1 < 1024 && chunks.find(a2, Chunk::calculateIndex(chunkx +1, chunky, chunkz))){
+	  a2->second->setLayerDirty(0, 0);
+	  a2->second->markEdited(msg.time);
 	  send_to_chunk_meshing_thread(a2->second, MESHING_PRIORITY_PLAYER_EDIT);
-	if(blocky == CHUNK_SIZE - 1 && chunky +1 < 1024 && chunks.find(b2, Chunk::calculateIndex(chunkx, chunky +1, chunkz)))
+	}
+	if(blocky == CHUNK_SIZE - 1 && chunky +1 < 1024 && chunks.find(b2, Chunk::calculateIndex(chunkx, chunky +1, chunkz))){
+	  b2->second->setLayerDirty(1, 0);
+	  b2->second->markEdited(msg.time);
 	  send_to_chunk_meshing_thread(b2->second, MESHING_PRIORITY_PLAYER_EDIT);
-	if(blockz == CHUNK_SIZE - 1 && chunkz +1 < 1024 && chunks.find(c2, Chunk::calculateIndex(chunkx, chunky, chunkz +1)))
+	}
+	if(blockz == CHUNK_SIZE - 1 && chunkz +1 < 1024 && chunks.find(c2, Chunk::calculateIndex(chunkx, chunky, chunkz +1))){
+	  c2->second->setLayerDirty(2, 0);
+	  c2->second->markEdited(msg.time);
 	  send_to_chunk_meshing_thread(c2->second, MESHING_PRIORITY_PLAYER_EDIT);
+	}
+
+	navigation::invalidate(glm::ivec3(chunkx, chunky, chunkz));
 
 	// Update debugging information
 
@@ -508,7 +735,7 @@ namespace chunkmanager
 	if(cx < 0 || cy < 0 || cz < 0 || cx > 1023 || cy > 1023 || cz > 1023) return Block::NULLBLK;
 
 	//std::cout << "Block at " << x << ", " << y << ", " << z << " is in chunk " << cx << "," << cy << "," << cz << "\n";
-	ChunkTable::accessor a;
+	ChunkTable::const_accessor a;
 	if(!chunks.find(a, Chunk::calculateIndex(cx, cy, cz))) return Block::NULLBLK;
 	else {
 	    int bx = x % CHUNK_SIZE;
@@ -1,12 +1,17 @@
 #include "chunkmesher.hpp"
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <bitset>
 #include <memory>
 
 #include "block.hpp"
 #include "chunk.hpp"
 #include "chunkmanager.hpp"
+#include "debugwindow.hpp"
 #include "globals.hpp"
+#include "occlusionculler.hpp"
 #include "renderer.hpp"
 #include "spacefilling.hpp"
 #include "utils.hpp"
@@ -16,20 +21,227 @@
 
 namespace chunkmesher{
 
-ChunkMeshDataQueue MeshDataQueue;
+ChunkMeshDataPool MeshDataQueue;
 
-ChunkMeshDataQueue& getMeshDataQueue(){ return MeshDataQueue; }
+ChunkMeshDataPool& getMeshDataQueue(){ return MeshDataQueue; }
+
+// Number of times the mesher found the pool empty and had to wait for the renderer
+std::atomic_int pool_exhausted{0};
+
+// Per-thread output arena. Quads are written in place here, sized for the worst case so that
+// meshing never reallocates, and are copied in a single go to the mesh data object at the end
+struct MeshArena{
+    std::unique_ptr<ChunkMeshQuad[]> quads{new ChunkMeshQuad[CHUNK_MESH_MAX_QUADS]};
+};
+thread_local MeshArena arena;
 
 void init()
 {
+    // Objects are only ever given back, so the renderer never blocks when pushing
+    MeshDataQueue.set_capacity(CHUNK_MESH_DATA_QUANTITY);
     for(int i = 0; i < CHUNK_MESH_DATA_QUANTITY; i++)
 	MeshDataQueue.push(new ChunkMeshData{});
 }
+
+void stop()
+{
+    // Wake up a mesher waiting on an empty pool
+    MeshDataQueue.abort();
+}
+
+ChunkMeshData* acquire_mesh_data()
+{
+    ChunkMeshData* mesh_data;
+    if(MeshDataQueue.try_pop(mesh_data)) return mesh_data;
+
+    // The pool is exhausted. Instead of dropping the mesh, block until the renderer gives some
+    // mesh data back. This also applies back-pressure on the meshing queue
+    pool_exhausted++;
+    debug::window::set_parameter("mesh_pool_exhausted", (int)pool_exhausted);
+    try{
+	MeshDataQueue.pop(mesh_data);
+    }catch(const oneapi::tbb::user_abort& e){
+	// Shutting down
+	return nullptr;
+    }
+    return mesh_data;
+}
     
+// Flood fill the air of the chunk starting from the borders, and record which faces each air
+// region touches. Faces touched by the same region can see each other through the chunk
+uint16_t compute_connectivity(const Block* blocks)
+{
+    thread_local std::bitset<CHUNK_VOLUME> visited;
+    // Voxels are pushed as x | y << 5 | z << 10
+    thread_local std::unique_ptr<uint16_t[]> stack{new uint16_t[CHUNK_VOLUME]};
+    static_assert(CHUNK_SIZE == 32, "Connectivity flood fill packs coordinates in 5 bits");
+
+    visited.reset();
+    uint16_t connectivity{0};
+
+    for(int sx = 0; sx < CHUNK_SIZE; sx++)
+    for(int sy = 0; sy < CHUNK_SIZE; sy++)
+    for(int sz = 0; sz < CHUNK_SIZE; sz++){
+	// Regions not reaching a border don't connect anything
+	if(sx != 0 && sx != CHUNK_SIZE - 1 && sy != 0 && sy != CHUNK_SIZE - 1 && sz != 0 && sz !=
+		CHUNK_SIZE - 1) continue;
+
+	const int seed = HILBERT_XYZ_ENCODE[sx][sy][sz];
+	if(visited[seed] || blocks[seed] != Block::AIR) continue;
+
+	int top{0};
+	int faces{0};
+	visited[seed] = true;
+	stack[top++] = sx | (sy << 5) | (sz << 10);
+
+	while(top > 0){
+	    const uint16_t p = stack[--top];
+	    const int c[3]{p & 31, (p >> 5) & 31, (p >> 10) & 31};
+
+	    for(int dim = 0; dim < 3; dim++){
+		if(c[dim] == 0) faces |= 1 << (2 * dim);
+		if(c[dim] == CHUNK_SIZE - 1) faces |= 1 << (2 * dim + 1);
+
+		for(int step = -1; step <= 1; step += 2){
+		    int n[3]{c[0], c[1], c[2]};
+		    n[dim] += step;
+		    if(n[dim] < 0 || n[dim] >= CHUNK_SIZE) continue;
+
+		    const int h = HILBERT_XYZ_ENCODE[n[0]][n[1]][n[2]];
+		    if(visited[h] || blocks[h] != Block::AIR) continue;
+		    visited[h] = true;
+		    stack[top++] = n[0] | (n[1] << 5) | (n[2] << 10);
+		}
+	    }
+	}
+
+	for(int a = 0; a < 6; a++)
+	    for(int b = a + 1; b < 6; b++)
+		if((faces & (1 << a)) && (faces & (1 << b))) connectivity |= 1 << Chunk::facePairBit(a, b);
+
+	if(connectivity == CHUNK_CONNECTIVITY_ALL) break;
+    }
+
+    return connectivity;
+}
+
+// Mesh the chunk at a lower level of detail: each voxel stands for a cube of 2^lod blocks, and
+// takes the most common solid block in the cube if at least half of it is solid.
+// Neighbouring chunks are not looked at, everything outside the chunk is considered air. This
+// closes the borders with skirts, so that there are no holes where chunks at different levels
+// of detail meet. Returns the number of quads written
+int mesh_lod(const Block* blocks, int lod, ChunkMeshData* mesh_data, ChunkMeshQuad* quads)
+{
+    const int size = CHUNK_SIZE >> lod;
+    const int factor = 1 << lod;
+    thread_local std::array<Block, CHUNK_VOLUME / 8> voxels;
+    std::array<Block, (CHUNK_SIZE / 2) * (CHUNK_SIZE / 2)> mask;
+    int num_quads{0};
+
+    // Downsample by majority vote
+    for(int x = 0; x < size; x++)
+    for(int y = 0; y < size; y++)
+    for(int z = 0; z < size; z++){
+	int counts[8]{};
+	for(int i = 0; i < factor; i++)
+	    for(int j = 0; j < factor; j++)
+		for(int k = 0; k < factor; k++)
+		    counts[(int)blocks[HILBERT_XYZ_ENCODE[x * factor + i][y * factor + j][z * factor + k]]]++;
+
+	int best = (int)Block::AIR;
+	if(2 * (factor * factor * factor - counts[(int)Block::AIR] - counts[(int)Block::NULLBLK]) >=
+		factor * factor * factor){
+	    best = (int)Block::STONE;
+	    for(int b = (int)Block::STONE; b < 8; b++) if(counts[b] > counts[best]) best = b;
+	}
+	voxels[(x * size + y) * size + z] = (Block)best;
+    }
+
+    auto voxel = [&](const int* c) {
+	if(c[0] < 0 || c[1] < 0 || c[2] < 0 || c[0] >= size || c[1] >= size || c[2] >= size)
+	    return Block::AIR;
+	return voxels[(c[0] * size + c[1]) * size + c[2]];
+    };
+
+    // Same greedy pass as the full detail mesher, over the downsampled voxels. The directions come
+    // in the same order
+    int direction{0};
+    for (bool backFace = true, b = false; b != backFace; backFace = backFace && b, b = !b)
+    {
+	for (int dim = 0; dim < 3; dim++, direction++)
+	{
+	    const int u = (dim + 1) % 3;
+	    const int v = (dim + 2) % 3;
+	    int x[]{0, 0, 0};
+	    int q[]{0, 0, 0};
+	    q[dim] = 1;
+
+	    mesh_data->direction_offsets[direction] = num_quads;
+	    for (x[dim] = -1; x[dim] < size;)
+	    {
+		int n = 0;
+		for (x[v] = 0; x[v] < size; x[v]++)
+		    for (x[u] = 0; x[u] < size; x[u]++)
+		    {
+			const int next[]{x[0] + q[0], x[1] + q[1], x[2] + q[2]};
+			const Block b1 = voxel(x), b2 = voxel(next);
+			mask[n++] = b1 == b2 ? Block::NULLBLK
+			    : backFace ? b1 == Block::AIR ? b2 : Block::NULLBLK
+			    : b2 == Block::AIR ? b1 : Block::NULLBLK;
+		    }
+
+		x[dim]++;
+		n = 0;
+		for (int j = 0; j < size; j++)
+		{
+		    for (int i = 0; i < size;)
+		    {
+			if (mask[n] == Block::NULLBLK)
+			{
+			    i++;
+			    n++;
+			    continue;
+			}
+
+			int w, h;
+			for (w = 1; i + w < size && mask[n + w] == mask[n]; w++);
+			for (h = 1; j + h < size; h++)
+			{
+			    bool done = false;
+			    for (int k = 0; k < w && !done; k++) done = mask[n + k + h * size] != mask[n];
+			    if (done) break;
+			}
+
+			if (mask[n] != Block::AIR)
+			{
+			    x[u] = i;
+			    x[v] = j;
+			    quads[num_quads++] = ChunkMeshQuad::pack(x[0], x[1], x[2], w, h, dim,
+				    !backFace, (int)(mask[n]) - 2, lod);
+			}
+
+			for (int l = 0; l < h; ++l)
+			    for (int k = 0; k < w; ++k)
+				mask[n + k + l * size] = Block::NULLBLK;
+
+			i += w;
+			n += w;
+		    }
+		}
+	    }
+	}
+    }
+    mesh_data->direction_offsets[6] = num_quads;
+
+    return num_quads;
+}
+
 void mesh(Chunk::Chunk* chunk)
 {
-    ChunkMeshData* mesh_data;
-    if(!MeshDataQueue.try_pop(mesh_data)) return;
+    ChunkMeshData* mesh_data = acquire_mesh_data();
+    if(mesh_data == nullptr) return;
+    ChunkMeshQuad* quads = arena.quads.get();
+    int num_quads{0};
 
     /*
      * Taking inspiration from 0fps and the jme3 porting at
@@ -51,24 +263,65 @@ void mesh(Chunk::Chunk* chunk)
     mesh_data->message_type = ChunkMeshDataType::MESH_UPDATE;
     mesh_data->index = chunk->getIndex();
     mesh_data->position = chunk->getPosition();
+    mesh_data->edit_time = chunk->takeEditTime();
 
     // convert tree to array since it is easier to work with it
     int length{0};
     std::unique_ptr<Block[]> blocks;
+    bool connectivity_dirty{false};
 
     int k, l, u, v, w, h, n, j, i;
+    int lod{0};
     int x[]{0, 0, 0};
     int q[]{0, 0, 0};
-    int du[]{0, 0, 0};
-    int dv[]{0, 0, 0};
+
+    // Only the layers touched since the last meshing need the greedy pass to run again, all the
+    // other slices are copied from the previous mesh
+    uint64_t dirty[3];
+    int slice{0};
+    ChunkMeshSlices* slices = chunk->getMeshSlices();
+    for(int d = 0; d < 3; d++) dirty[d] = chunk->takeDirtyLayers(d);
 
     // Abort if chunk is empty
-    if(chunk->getState(Chunk::CHUNK_STATE_EMPTY)) goto end;
+    if(chunk->getState(Chunk::CHUNK_STATE_EMPTY)) goto empty;
 
-    blocks = chunk->getBlocksArray(&length);
-    if(length == 0) goto end;
+    // Copied while holding the chunk in the chunk table. Edits (blockpick on the edit thread,
+    // worldedit) hold it exclusively while they write, and the update loop can queue the chunk
+    // again in the meantime, so the queue flags alone don't keep them out
+    {
+	chunkmanager::ChunkTable::const_accessor a;
+	if(chunkmanager::getChunks().find(a, chunk->getIndex())){
+	    blocks = chunk->getBlocksArray(&length);
+	    connectivity_dirty = chunk->takeConnectivityDirty();
+	}
+    }
+    if(length == 0) goto empty;
+
+    // The flood fill goes through the whole chunk, edits that only swap one solid block for
+    // another (or remeshes for a new level of detail) keep the connectivity they had
+    mesh_data->connectivity = connectivity_dirty ? compute_connectivity(blocks.get()) :
+	chunk->getConnectivity();
+
+    lod = chunk->getLod();
+    if(lod > 0){
+	// Low detail meshes are always built from scratch, the full detail slices are not needed
+	// anymore. They will be built again when the chunk gets back to full detail
+	chunk->setMeshSlices(nullptr);
+	num_quads = mesh_lod(blocks.get(), lod, mesh_data, quads);
+	goto end;
+    }
+
+    // First time meshing, everything is dirty
+    if(slices == nullptr){
+	slices = new ChunkMeshSlices{};
+	chunk->setMeshSlices(slices);
+	dirty[0] = dirty[1] = dirty[2] = ~0ULL;
+    }
 
     std::array<Block, CHUNK_SIZE * CHUNK_SIZE> mask;
+    // Layer of the neighbouring chunk across the border being meshed
+    std::array<Block, CHUNK_SIZE * CHUNK_SIZE> border;
+    int border_size[3];
     for (bool backFace = true, b = false; b != backFace; backFace = backFace && b, b = !b)
     {
         // iterate over 3 dimensions
@@ -89,41 +342,51 @@ void mesh(Chunk::Chunk* chunk)
                         // voxels
                         // on
 
-            for (x[dim] = -1; x[dim] < CHUNK_SIZE;)
+            for (x[dim] = -1; x[dim] < CHUNK_SIZE; slice++)
             {
+                const int start = num_quads;
+
+                // Layer unchanged, reuse the quads from the previous mesh
+                if(!(dirty[dim] & (1ULL << (x[dim] + 1)))){
+                    const int old_start = slices->offsets[slice];
+                    const int old_end = slices->offsets[slice + 1];
+                    std::copy(slices->quads.begin() + old_start, slices->quads.begin() + old_end, quads + num_quads);
+                    num_quads += old_end - old_start;
+                    slices->offsets[slice] = start;
+
+                    x[dim]++;
+                    continue;
+                }
+
                 n = 0;
 
+                // The faces on the borders of the chunk need the blocks of the neighbour, read the
+                // whole layer at once
+                if(x[dim] == -1 || x[dim] == CHUNK_SIZE - 1){
+                    glm::ivec3 min = glm::ivec3(chunk->getPosition()) * CHUNK_SIZE;
+                    min[dim] += x[dim] == -1 ? -1 : CHUNK_SIZE;
+                    glm::ivec3 max = min;
+                    max[u] += CHUNK_SIZE - 1;
+                    max[v] += CHUNK_SIZE - 1;
+                    chunkmanager::getBlocksInRegion(min, max, border.data());
+
+                    border_size[dim] = 1;
+                    border_size[u] = border_size[v] = CHUNK_SIZE;
+                }
+
                 for (x[v] = 0; x[v] < CHUNK_SIZE; x[v]++)
                 {
                     for (x[u] = 0; x[u] < CHUNK_SIZE; x[u]++)
                     {
 			Block b1, b2;
 			if(x[dim] >= 0) b1 = blocks[HILBERT_XYZ_ENCODE[x[0]][x[1]][x[2]]];
-			else{
-			    int cx = chunk->getPosition().x*CHUNK_SIZE;
-			    int cy = chunk->getPosition().y*CHUNK_SIZE;
-			    int cz = chunk->getPosition().z*CHUNK_SIZE;
-
-			    int bx = cx+x[0];
-			    int by = cy+x[1];
-			    int bz = cz+x[2];
-
-			    b1 = chunkmanager::getBlockAtPos(bx, by, bz);
-			}
+			else b1 = border[((dim == 0 ? 0 : x[0]) * border_size[1] + (dim == 1 ? 0 : x[1])) *
+			    border_size[2] + (dim == 2 ? 0 : x[2])];
 
 			if(x[dim] < CHUNK_SIZE - 1) b2 = blocks[HILBERT_XYZ_ENCODE[x[0] + q[0]][x[1]
 			    + q[1]][x[2] + q[2]]];
-			else{
-			    int cx = chunk->getPosition().x*CHUNK_SIZE;
-			    int cy = chunk->getPosition().y*CHUNK_SIZE;
-			    int cz = chunk->getPosition().z*CHUNK_SIZE;
-
-			    int bx = cx+x[0] + q[0];
-			    int by = cy+x[1] + q[1];
-			    int bz = cz+x[2] + q[2];
-
-			    b2 = chunkmanager::getBlockAtPos(bx, by, bz);
-			}
+			else b2 = border[((dim == 0 ? 0 : x[0]) * border_size[1] + (dim == 1 ? 0 : x[1])) *
+			    border_size[2] + (dim == 2 ? 0 : x[2])];
 
 			// Compute the mask
 			// Checking if b1==b2 is needed to generate a single quad
@@ -177,29 +440,9 @@ void mesh(Chunk::Chunk* chunk)
                                 x[u] = i;
                                 x[v] = j;
 
-                                du[0] = 0;
-                                du[1] = 0;
-                                du[2] = 0;
-                                du[u] = w;
-
-                                dv[0] = 0;
-                                dv[1] = 0;
-                                dv[2] = 0;
-                                dv[v] = h;
-
-				// bottom left
-				mesh_data->vertices.push_back(x[0]); //bottomLeft.x
-				mesh_data->vertices.push_back(x[1]); //bottomLeft.y
-				mesh_data->vertices.push_back(x[2]); //bottomLeft.z
-
-				// extents, use normals for now
-				mesh_data->extents.push_back(du[0] + dv[0]);
-				mesh_data->extents.push_back(du[1] + dv[1]);
-				mesh_data->extents.push_back(du[2] + dv[2]);
-
-				mesh_data->texinfo.push_back(backFace ? 0.0 : 1.0);
-				mesh_data->texinfo.push_back((int)(mask[n]) - 2);
-				mesh_data->num_vertices++;
+				// Write the quad in place in the arena
+				quads[num_quads++] = ChunkMeshQuad::pack(x[0], x[1], x[2], w, h, dim,
+					!backFace, (int)(mask[n]) - 2);
                             }
 
                             for (l = 0; l < h; ++l)
@@ -224,11 +467,53 @@ void mesh(Chunk::Chunk* chunk)
                         }
                     }
                 }
+
+                slices->offsets[slice] = start;
             }
         }
     }
 
+    // Keep the slices for the next time the chunk is meshed
+    slices->offsets[CHUNK_MESH_SLICES] = num_quads;
+    slices->quads.assign(quads, quads + num_quads);
+
+    // Slices are already grouped by face direction, so are the quads
+    for(int d = 0; d < 6; d++) mesh_data->direction_offsets[d] = slices->offsets[d * (CHUNK_SIZE + 1)];
+    mesh_data->direction_offsets[6] = num_quads;
+    goto end;
+
+empty:
+    // Nothing to keep for an empty chunk, it will be meshed from scratch once something is placed
+    chunk->setMeshSlices(nullptr);
+
 end:
+    mesh_data->quads.assign(quads, quads + num_quads);
+    mesh_data->num_vertices = num_quads;
+
+    // Tight bounds of the mesh, used by the renderer for culling
+    if(num_quads > 0){
+	glm::ivec3 aabb_min(CHUNK_SIZE), aabb_max(0);
+	for(int i = 0; i < num_quads; i++){
+	    aabb_min = glm::min(aabb_min, quads[i].corner());
+	    aabb_max = glm::max(aabb_max, quads[i].corner() + quads[i].extents());
+	}
+	mesh_data->aabb_min = aabb_min;
+	mesh_data->aabb_max = aabb_max;
+
+	// The biggest quads become occluders. Blocks are opaque, so any face hides what's behind it
+	for(int i = 0; i < num_quads; i++)
+	    if(quads[i].area() >= OCCLUDER_MIN_AREA)
+		mesh_data->occluders.push_back(quads[i]);
+	if(mesh_data->occluders.size() > CHUNK_MAX_OCCLUDERS){
+	    std::partial_sort(mesh_data->occluders.begin(), mesh_data->occluders.begin() +
+		    CHUNK_MAX_OCCLUDERS, mesh_data->occluders.end(), [](const ChunkMeshQuad& u, const
+			ChunkMeshQuad& v){ return u.area() > v.area(); });
+	    mesh_data->occluders.resize(CHUNK_MAX_OCCLUDERS);
+	}
+    }
+
+    chunk->setConnectivity(mesh_data->connectivity);
+    chunk->setMeshLod(chunk->getLod());
     chunk->setState(Chunk::CHUNK_STATE_MESHED, true);
     renderer::getMeshDataQueue().push(mesh_data);
 }
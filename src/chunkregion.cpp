@@ -0,0 +1,112 @@
+#include "chunkmanager.hpp"
+
+#include <algorithm>
+#include <array>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "block.hpp"
+#include "chunk.hpp"
+#include "globals.hpp"
+
+// Reading the blocks of a region out of the chunk table. Kept apart from the rest of the chunk
+// manager so that tools editing regions can be built and checked without the threads, the
+// renderer and the generator
+namespace chunkmanager
+{
+    // Ranges of Hilbert indices of the blocks of the cube (origin, side) that are inside [lo, hi],
+    // all in chunk coordinates. An aligned cube of side s (a power of two) is a contiguous range of
+    // s^3 indices starting at a multiple of s^3, so the part is split into the biggest cubes that
+    // fit in it
+    void split_hilbert_ranges(glm::ivec3 origin, int side, glm::ivec3 lo, glm::ivec3 hi,
+	    std::vector<std::pair<int, int>>& ranges){
+	const glm::ivec3 last = origin + side - 1;
+	if(glm::any(glm::greaterThan(origin, hi)) || glm::any(glm::lessThan(last, lo))) return;
+
+	if(glm::all(glm::greaterThanEqual(origin, lo)) && glm::all(glm::lessThanEqual(last, hi))){
+	    const int volume = side * side * side;
+	    const int start = HILBERT_XYZ_ENCODE[origin.x][origin.y][origin.z] / volume * volume;
+	    if(!ranges.empty() && ranges.back().second == start) ranges.back().second += volume;
+	    else ranges.emplace_back(start, start + volume);
+	    return;
+	}
+
+	// Children in the order the curve goes through them, so that the ranges come out sorted
+	const int half = side / 2;
+	const int volume = half * half * half;
+	std::array<std::pair<int, int>, 8> children;
+	for(int i = 0; i < 8; i++){
+	    const glm::ivec3 o = origin + glm::ivec3(i & 1, (i >> 1) & 1, (i >> 2) & 1) * half;
+	    children[i] = {HILBERT_XYZ_ENCODE[o.x][o.y][o.z] / volume, i};
+	}
+	std::sort(children.begin(), children.end());
+	for(const auto& [order, i] : children)
+	    split_hilbert_ranges(origin + glm::ivec3(i & 1, (i >> 1) & 1, (i >> 2) & 1) * half, half,
+		    lo, hi, ranges);
+    }
+
+    // Same, for the whole chunk. The mesher asks for the same few parts (the faces of the chunk)
+    // over and over, so the ranges are remembered. Valid until the next call from the same thread
+    const std::vector<std::pair<int, int>>& hilbert_ranges(glm::ivec3 lo, glm::ivec3 hi){
+	static_assert(CHUNK_SIZE <= 32, "Chunk coordinates must fit in 5 bits");
+	constexpr size_t cache_size = 64;
+	thread_local std::unordered_map<uint32_t, std::vector<std::pair<int, int>>> cache;
+
+	const uint32_t key = lo.x | lo.y << 5 | lo.z << 10 | hi.x << 15 | hi.y << 20 | hi.z << 25;
+	auto found = cache.find(key);
+	if(found != cache.end()) return found->second;
+
+	if(cache.size() >= cache_size) cache.clear();
+	auto& ranges = cache[key];
+	split_hilbert_ranges(glm::ivec3(0), CHUNK_SIZE, lo, hi, ranges);
+	return ranges;
+    }
+
+    void getBlocksInRegion(glm::ivec3 min, glm::ivec3 max, Block* buffer){
+	if(glm::any(glm::lessThan(max, min))) return;
+	const glm::ivec3 size = max - min + 1;
+	std::fill(buffer, buffer + size.x * size.y * size.z, Block::NULLBLK);
+
+	// Only the part inside the world can be read
+	const glm::ivec3 wmin = glm::max(min, glm::ivec3(0));
+	const glm::ivec3 wmax = glm::min(max, glm::ivec3(1024 * CHUNK_SIZE - 1));
+	if(glm::any(glm::lessThan(wmax, wmin))) return;
+
+	auto at = [&](glm::ivec3 p) -> Block& {
+	    const glm::ivec3 r = p - min;
+	    return buffer[(r.x * size.y + r.y) * size.z + r.z];
+	};
+
+	const glm::ivec3 cmin = wmin / CHUNK_SIZE;
+	const glm::ivec3 cmax = wmax / CHUNK_SIZE;
+	for(int cx = cmin.x; cx <= cmax.x; cx++)
+	for(int cy = cmin.y; cy <= cmax.y; cy++)
+	for(int cz = cmin.z; cz <= cmax.z; cz++){
+	    ChunkTable::const_accessor a;
+	    if(!getChunks().find(a, Chunk::calculateIndex(cx, cy, cz))) continue;
+	    Chunk::Chunk* c = a->second;
+
+	    // Part of the region inside this chunk, in chunk coordinates
+	    const glm::ivec3 origin = glm::ivec3(cx, cy, cz) * CHUNK_SIZE;
+	    const glm::ivec3 lo = glm::max(wmin - origin, glm::ivec3(0));
+	    const glm::ivec3 hi = glm::min(wmax - origin, glm::ivec3(CHUNK_SIZE - 1));
+
+	    // Blocks past the end of the map (or of a chunk not generated yet) are air
+	    for(int x = lo.x; x <= hi.x; x++)
+	    for(int y = lo.y; y <= hi.y; y++)
+	    for(int z = lo.z; z <= hi.z; z++)
+		at(origin + glm::ivec3(x, y, z)) = Block::AIR;
+	    if(!c->getState(Chunk::CHUNK_STATE_GENERATED)) continue;
+
+	    // Only the runs overlapping the part are walked, all of its blocks are in the ranges
+	    c->getBlocks().forEachRunInRanges(hilbert_ranges(lo, hi), [&](int start, int end, Block b){
+		for(int h = start; h < end; h++)
+		    at(origin + glm::ivec3(HILBERT_XYZ_DECODE[h][0], HILBERT_XYZ_DECODE[h][1],
+				HILBERT_XYZ_DECODE[h][2])) = b;
+	    });
+	}
+    }
+};
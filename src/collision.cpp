@@ -0,0 +1,167 @@
+#include "collision.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <numeric>
+#include <random>
+
+#include <oneapi/tbb/parallel_for.h>
+
+#include "chunkmanager.hpp"
+#include "debugwindow.hpp"
+
+namespace collision{
+    // Totals over all the batches, for the debug window
+    std::atomic_int cache_hits{0}, cache_misses{0};
+
+    const ChunkCache::Entry& lookup(ChunkCache& cache, glm::ivec3 chunk){
+	// Chunks in the same 4x2x4 block never share an entry
+	const int slot = (chunk.x & 3) | (chunk.y & 1) << 2 | (chunk.z & 3) << 3;
+	const chunk_index_t index = Chunk::calculateIndex(chunk.x, chunk.y, chunk.z);
+
+	ChunkCache::Entry& e = cache.entries[slot];
+	if(e.index == index){
+	    cache.hits++;
+	    return e;
+	}
+
+	cache.misses++;
+	e.index = index;
+	e.occupancy.reset();
+	e.solid = true;
+
+	chunkmanager::ChunkTable::const_accessor a;
+	if(chunkmanager::getChunks().find(a, index) &&
+		a->second->getState(Chunk::CHUNK_STATE_GENERATED)){
+	    Chunk::Chunk* c = a->second;
+	    e.solid = false;
+	    if(!c->getState(Chunk::CHUNK_STATE_EMPTY)) e.occupancy = c->getOccupancy();
+	}
+	return e;
+    }
+
+    bool isSolid(ChunkCache& cache, glm::ivec3 block){
+	if(glm::any(glm::lessThan(block, glm::ivec3(0))) || glm::any(glm::greaterThanEqual(block,
+			glm::ivec3(1024 * CHUNK_SIZE)))) return true;
+
+	const glm::ivec3 chunk = block / CHUNK_SIZE;
+	const ChunkCache::Entry& e = lookup(cache, chunk);
+	if(!e.occupancy) return e.solid;
+
+	const glm::ivec3 p = block - chunk * CHUNK_SIZE;
+	return e.occupancy->test(p.x + p.y * CHUNK_SIZE + p.z * CHUNK_SIZE * CHUNK_SIZE);
+    }
+
+    // Whether any block of layer l along axis a, within the cells covered by the box on the other
+    // two axes, is solid
+    bool layerBlocked(ChunkCache& cache, const glm::vec3& min, const glm::vec3& max, int a, int l){
+	const int b = (a + 1) % 3, c = (a + 2) % 3;
+	const int b0 = std::floor(min[b]), b1 = std::ceil(max[b]) - 1;
+	const int c0 = std::floor(min[c]), c1 = std::ceil(max[c]) - 1;
+
+	glm::ivec3 block;
+	block[a] = l;
+	for(block[b] = b0; block[b] <= b1; block[b]++)
+	    for(block[c] = c0; block[c] <= c1; block[c]++)
+		if(isSolid(cache, block)) return true;
+	return false;
+    }
+
+    glm::vec3 sweep(ChunkCache& cache, glm::vec3 min, glm::vec3 max, glm::vec3 motion, glm::bvec3*
+	    blocked){
+	if(blocked) *blocked = glm::bvec3(false);
+
+	// One axis at a time, vertical first so that an entity falling on the ground still slides
+	// along it
+	for(int a : {1, 0, 2}){
+	    float m = motion[a];
+	    if(m > 0){
+		// Layers the leading face goes through, the ones the box already overlaps excluded
+		const int first = std::ceil(max[a]);
+		const int last = std::ceil(max[a] + m) - 1;
+		for(int l = first; l <= last; l++)
+		    if(layerBlocked(cache, min, max, a, l)){
+			m = std::max(0.0f, l - max[a] - COLLISION_SKIN);
+			if(blocked) (*blocked)[a] = true;
+			break;
+		    }
+	    }else if(m < 0){
+		const int first = std::floor(min[a]) - 1;
+		const int last = std::floor(min[a] + m);
+		for(int l = first; l >= last; l--)
+		    if(layerBlocked(cache, min, max, a, l)){
+			m = std::min(0.0f, l + 1 - min[a] + COLLISION_SKIN);
+			if(blocked) (*blocked)[a] = true;
+			break;
+		    }
+	    }
+
+	    motion[a] = m;
+	    min[a] += m;
+	    max[a] += m;
+	}
+
+	return motion;
+    }
+
+    void moveBatch(std::vector<Entity>& entities, float dt){
+	// Entities in the same chunk next to each other, so that they share the cache
+	std::vector<uint32_t> order(entities.size());
+	std::vector<chunk_index_t> keys(entities.size());
+	for(size_t i = 0; i < entities.size(); i++){
+	    const glm::ivec3 c = glm::clamp(glm::ivec3(glm::floor(entities[i].position / (float)
+			    CHUNK_SIZE)), glm::ivec3(0), glm::ivec3(1023));
+	    keys[i] = Chunk::calculateIndex(c.x, c.y, c.z);
+	}
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [&](uint32_t u, uint32_t v){ return keys[u] < keys[v];
+		});
+
+	oneapi::tbb::parallel_for(oneapi::tbb::blocked_range<size_t>(0, order.size()),
+		[&](const oneapi::tbb::blocked_range<size_t>& r){
+		    ChunkCache cache;
+		    for(size_t i = r.begin(); i != r.end(); i++){
+			Entity& e = entities[order[i]];
+			glm::bvec3 blocked;
+			const glm::vec3 moved = sweep(cache, e.position - e.half_size, e.position +
+				e.half_size, e.velocity * dt, &blocked);
+
+			e.position += moved;
+			e.on_ground = blocked.y && e.velocity.y < 0;
+			for(int a = 0; a < 3; a++) if(blocked[a]) e.velocity[a] = 0;
+		    }
+		    cache_hits += cache.hits;
+		    cache_misses += cache.misses;
+		});
+    }
+
+    double benchmark(glm::vec3 origin, int count, int steps){
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> spread(-32.0f, 32.0f);
+	std::uniform_real_distribution<float> speed(-4.0f, 4.0f);
+	std::uniform_real_distribution<float> fall(-10.0f, 2.0f);
+
+	std::vector<Entity> entities(count);
+	for(auto& e : entities){
+	    e.position = origin + glm::vec3(spread(rng), spread(rng), spread(rng));
+	    e.half_size = glm::vec3(0.3f, 0.9f, 0.3f);
+	    e.velocity = glm::vec3(speed(rng), fall(rng), speed(rng));
+	}
+
+	cache_hits = cache_misses = 0;
+	const auto start = std::chrono::steady_clock::now();
+	for(int i = 0; i < steps; i++) moveBatch(entities, 1.0f / 60.0f);
+	const double elapsed = std::chrono::duration<double, std::milli>(
+		std::chrono::steady_clock::now() - start).count();
+
+	int grounded{0};
+	for(const auto& e : entities) grounded += e.on_ground;
+	debug::window::set_parameter("collision_benchmark_grounded", grounded);
+	debug::window::set_parameter("collision_benchmark_time", (float)elapsed);
+	debug::window::set_parameter("collision_benchmark_cache_hits", (int)cache_hits);
+	debug::window::set_parameter("collision_benchmark_cache_misses", (int)cache_misses);
+	return elapsed > 0 ? count * steps / elapsed : 0;
+    }
+};
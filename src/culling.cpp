@@ -0,0 +1,173 @@
+#include "culling.hpp"
+
+#include <unordered_map>
+
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+namespace culling{
+    std::unordered_map<int32_t, CullGroup> groups;
+    int num_chunks{0};
+
+    int32_t groupKey(glm::vec3 chunk){
+	glm::ivec3 g = glm::floor(chunk / static_cast<float>(CULL_GROUP_SIZE));
+	return (g.x & 1023) | ((g.y & 1023) << 10) | ((g.z & 1023) << 20);
+    }
+
+    void insert(renderer::RenderInfo* render_info){
+	const int32_t key = groupKey(render_info->position);
+	auto found = groups.find(key);
+	if(found == groups.end()){
+	    // The group spans its whole cube of chunks, no need to keep it tight
+	    CullGroup g{};
+	    glm::vec3 origin = glm::floor(render_info->position / static_cast<float>(CULL_GROUP_SIZE));
+	    g.min = origin * static_cast<float>(CULL_GROUP_SIZE * CHUNK_SIZE);
+	    g.max = g.min + static_cast<float>(CULL_GROUP_SIZE * CHUNK_SIZE);
+	    found = groups.emplace(key, g).first;
+	}
+
+	CullGroup& g = found->second;
+	render_info->cull_index = g.members.size();
+	g.min_x.push_back(render_info->aabb_min.x);
+	g.min_y.push_back(render_info->aabb_min.y);
+	g.min_z.push_back(render_info->aabb_min.z);
+	g.max_x.push_back(render_info->aabb_max.x);
+	g.max_y.push_back(render_info->aabb_max.y);
+	g.max_z.push_back(render_info->aabb_max.z);
+	g.members.push_back(render_info);
+	num_chunks++;
+    }
+
+    void remove(renderer::RenderInfo* render_info){
+	if(render_info->cull_index < 0) return;
+
+	auto found = groups.find(groupKey(render_info->position));
+	if(found == groups.end()) return;
+	CullGroup& g = found->second;
+
+	// Swap with the last member and shrink, keeping the arrays contiguous
+	const int i = render_info->cull_index;
+	const int last = g.members.size() - 1;
+	g.min_x[i] = g.min_x[last];
+	g.min_y[i] = g.min_y[last];
+	g.min_z[i] = g.min_z[last];
+	g.max_x[i] = g.max_x[last];
+	g.max_y[i] = g.max_y[last];
+	g.max_z[i] = g.max_z[last];
+	g.members[i] = g.members[last];
+	g.members[i]->cull_index = i;
+
+	g.min_x.pop_back();
+	g.min_y.pop_back();
+	g.min_z.pop_back();
+	g.max_x.pop_back();
+	g.max_y.pop_back();
+	g.max_z.pop_back();
+	g.members.pop_back();
+	render_info->cull_index = -1;
+	num_chunks--;
+
+	if(g.members.empty()) groups.erase(found);
+    }
+
+    void update(renderer::RenderInfo* render_info){
+	if(render_info->cull_index < 0){
+	    insert(render_info);
+	    return;
+	}
+
+	CullGroup& g = groups[groupKey(render_info->position)];
+	const int i = render_info->cull_index;
+	g.min_x[i] = render_info->aabb_min.x;
+	g.min_y[i] = render_info->aabb_min.y;
+	g.min_z[i] = render_info->aabb_min.z;
+	g.max_x[i] = render_info->aabb_max.x;
+	g.max_y[i] = render_info->aabb_max.y;
+	g.max_z[i] = render_info->aabb_max.z;
+    }
+
+    int size(){
+	return num_chunks;
+    }
+
+    // Signed distance of p from the plane. The terms are summed in this order everywhere, so that
+    // cullMembers agrees with testBox to the last bit
+    float distance(const glm::vec4& plane, glm::vec3 p){
+	return ((plane.x * p.x + plane.y * p.y) + plane.z * p.z) + plane.w;
+    }
+
+    Visibility testBox(glm::vec3 min, glm::vec3 max, const glm::vec4 planes[6]){
+	Visibility result = Visibility::INSIDE;
+	for(int p = 0; p < 6; p++){
+	    const glm::vec4& plane = planes[p];
+	    // The corners of the box furthest along and against the normal of the plane
+	    glm::vec3 pv(plane.x > 0 ? max.x : min.x, plane.y > 0 ? max.y : min.y, plane.z > 0 ? max.z : min.z);
+	    glm::vec3 nv(plane.x > 0 ? min.x : max.x, plane.y > 0 ? min.y : max.y, plane.z > 0 ? min.z : max.z);
+
+	    if(distance(plane, pv) < 0) return Visibility::OUTSIDE;
+	    if(distance(plane, nv) < 0) result = Visibility::INTERSECT;
+	}
+	return result;
+    }
+
+    void cullMembers(const CullGroup& g, const glm::vec4 planes[6], std::vector<renderer::RenderInfo*>& visible){
+	const size_t n = g.members.size();
+	size_t i = 0;
+
+#ifdef __SSE2__
+	// 4 boxes at a time. For each plane only the corner furthest along its normal needs to be
+	// tested, and which one it is only depends on the plane: pick whole arrays instead of
+	// branching on every box
+	const __m128 zero = _mm_setzero_ps();
+	for(; i + 4 <= n; i += 4){
+	    __m128 outside = zero;
+	    for(int p = 0; p < 6; p++){
+		const glm::vec4& plane = planes[p];
+		__m128 x = _mm_loadu_ps((plane.x > 0 ? g.max_x : g.min_x).data() + i);
+		__m128 y = _mm_loadu_ps((plane.y > 0 ? g.max_y : g.min_y).data() + i);
+		__m128 z = _mm_loadu_ps((plane.z > 0 ? g.max_z : g.min_z).data() + i);
+
+		// Same order as distance()
+		__m128 d = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x)), _mm_mul_ps(y,
+			    _mm_set1_ps(plane.y)));
+		d = _mm_add_ps(d, _mm_mul_ps(z, _mm_set1_ps(plane.z)));
+		d = _mm_add_ps(d, _mm_set1_ps(plane.w));
+		outside = _mm_or_ps(outside, _mm_cmplt_ps(d, zero));
+	    }
+
+	    const int mask = _mm_movemask_ps(outside);
+	    for(int k = 0; k < 4; k++) if(!(mask & (1 << k))) visible.push_back(g.members[i + k]);
+	}
+#endif
+
+	// Leftovers (or everything, without SSE)
+	for(; i < n; i++){
+	    bool out = false;
+	    for(int p = 0; p < 6 && !out; p++){
+		const glm::vec4& plane = planes[p];
+		out = distance(plane, glm::vec3(plane.x > 0 ? g.max_x[i] : g.min_x[i], plane.y > 0 ?
+			    g.max_y[i] : g.min_y[i], plane.z > 0 ? g.max_z[i] : g.min_z[i])) < 0;
+	    }
+	    if(!out) visible.push_back(g.members[i]);
+	}
+    }
+
+    int cull(const glm::vec4 planes[6], std::vector<renderer::RenderInfo*>& visible){
+	int tested{0};
+	for(const auto& [key, g] : groups){
+	    switch(testBox(g.min, g.max, planes)){
+		case Visibility::OUTSIDE:
+		    break;
+		case Visibility::INSIDE:
+		    visible.insert(visible.end(), g.members.begin(), g.members.end());
+		    break;
+		case Visibility::INTERSECT:
+		    cullMembers(g, planes, visible);
+		    tested += g.members.size();
+		    break;
+	    }
+	}
+	return tested;
+    }
+};
@@ -5,6 +5,7 @@
 #include <imgui/imgui_impl_glfw.h>
 #include <imgui_stdlib.h>
 
+#include <atomic>
 #include <iostream>
 #include <string>
 #include <unordered_map>
@@ -59,6 +60,25 @@ namespace debug{
 	    parameters[key] = value;
 	}
 
+	// Settings read by other threads are atomics, the widgets edit a copy
+	void slider_atomic(const char* label, const std::string& key, int min, int max){
+	    auto setting = std::any_cast<std::atomic_int*>(parameters.at(key));
+	    int value = *setting;
+	    if(ImGui::SliderInt(label, &value, min, max)) *setting = value;
+	}
+
+	void checkbox_atomic(const char* label, const std::string& key){
+	    auto setting = std::any_cast<std::atomic_bool*>(parameters.at(key));
+	    bool value = *setting;
+	    if(ImGui::Checkbox(label, &value)) *setting = value;
+	}
+
+	void combo_atomic(const char* label, const std::string& key, const char* items){
+	    auto setting = std::any_cast<std::atomic_int*>(parameters.at(key));
+	    int value = *setting;
+	    if(ImGui::Combo(label, &value, items)) *setting = value;
+	}
+
 	void show_debug_window(){
 	    ImGui::Begin("Debug Window");
 
@@ -79,6 +99,8 @@ namespace debug{
 		    ImGui::Text("X: %f, Y: %f, Z: %f",
 			    std::any_cast<float>(parameters.at("px")),std::any_cast<float>(parameters.at("py")),std::any_cast<float>(parameters.at("pz"))  );
 		    ImGui::Text("X: %d, Y: %d, Z: %d (chunk)", std::any_cast<int>(parameters.at("cx")),std::any_cast<int>(parameters.at("cy")),std::any_cast<int>(parameters.at("cz"))  );
+		    if(parameters.find("surface_height") != parameters.end())
+			ImGui::Text("Surface height: %d", std::any_cast<int>(parameters.at("surface_height")));
 		    ImGui::Text("Pointing in direction: %f, %f, %f", 
 			    std::any_cast<float>(parameters.at("lx")),std::any_cast<float>(parameters.at("ly")),std::any_cast<float>(parameters.at("lz"))  );
 
@@ -87,6 +109,23 @@ namespace debug{
 		    ImGui::SliderInt("Block to place",
 			    std::any_cast<int*>(parameters.at("block_type_return")), 2, 6);
 
+		    checkbox_atomic("Run raycast benchmark", "raycast_benchmark_return");
+		    if(parameters.find("raycast_benchmark_rate") != parameters.end())
+			ImGui::Text("Raycast: %.0f rays/s, %d hits in %.2f ms",
+			    std::any_cast<float>(parameters.at("raycast_benchmark_rate")),
+			    std::any_cast<int>(parameters.at("raycast_benchmark_hits")),
+			    std::any_cast<float>(parameters.at("raycast_benchmark_time")));
+		    checkbox_atomic("Run collision benchmark", "collision_benchmark_return");
+		    if(parameters.find("collision_benchmark_rate") != parameters.end()){
+			ImGui::Text("Collision: %.0f entities/ms, %d on the ground, %.2f ms",
+			    std::any_cast<float>(parameters.at("collision_benchmark_rate")),
+			    std::any_cast<int>(parameters.at("collision_benchmark_grounded")),
+			    std::any_cast<float>(parameters.at("collision_benchmark_time")));
+			ImGui::Text("Collision chunk cache: %d hits, %d misses",
+			    std::any_cast<int>(parameters.at("collision_benchmark_cache_hits")),
+			    std::any_cast<int>(parameters.at("collision_benchmark_cache_misses")));
+		    }
+
 		    if(parameters.find("block_last_action") != parameters.end()){
 			ImGui::Text("Last Block action: %s",
 			    std::any_cast<bool>(parameters.at("block_last_action")) ? "place" : "destroy");
@@ -95,6 +134,12 @@ namespace debug{
 			ImGui::Text("Last Block action position: X: %d, Y: %d, Z: %d",
 			    std::any_cast<int>(parameters.at("block_last_action_x")),std::any_cast<int>(parameters.at("block_last_action_y")),std::any_cast<int>(parameters.at("block_last_action_z"))  );
 		    }
+		    if(parameters.find("edit_latency_apply") != parameters.end())
+			ImGui::Text("Last edit applied after %.2f ms",
+			    std::any_cast<float>(parameters.at("edit_latency_apply")));
+		    if(parameters.find("edit_latency_upload") != parameters.end())
+			ImGui::Text("Last edit on the GPU after %.2f ms",
+			    std::any_cast<float>(parameters.at("edit_latency_upload")));
 		}
 
 		if(ImGui::CollapsingHeader("Mesh")){
@@ -108,8 +153,55 @@ namespace debug{
 			std::any_cast<int>(parameters.at("render_chunks_culled")));
 		    ImGui::Text("Total vertices in the scene: %d",
 			std::any_cast<int>(parameters.at("render_chunks_vertices")));
+		    ImGui::Text("Frustum culling: %.3f ms, %d chunks tested individually",
+			std::any_cast<float>(parameters.at("render_cull_time")),
+			std::any_cast<int>(parameters.at("render_cull_tested")));
+		    ImGui::Checkbox("Cave culling",
+			std::any_cast<bool*>(parameters.at("connectivity_culling_return")));
+		    ImGui::Text("Cave culling: %d chunks unreachable from the camera, %.3f ms",
+			std::any_cast<int>(parameters.at("render_connectivity_culled")),
+			std::any_cast<float>(parameters.at("render_connectivity_time")));
+		    ImGui::Checkbox("Occlusion culling",
+			std::any_cast<bool*>(parameters.at("occlusion_culling_return")));
+		    ImGui::Text("Occlusion culling: %d chunks hidden by %d occluders, %.3f ms",
+			std::any_cast<int>(parameters.at("render_occlusion_culled")),
+			std::any_cast<int>(parameters.at("render_occlusion_occluders")),
+			std::any_cast<float>(parameters.at("render_occlusion_time")));
+		    ImGui::Text("Draw calls: %d",
+			std::any_cast<int>(parameters.at("render_draw_calls")));
+		    ImGui::Text("Draw ranges: %d, back facing quads skipped: %d",
+			std::any_cast<int>(parameters.at("render_draw_ranges")),
+			std::any_cast<int>(parameters.at("render_backfacing_quads")));
+		    if(parameters.find("far_terrain_vertices") != parameters.end()){
+			ImGui::Text("Far terrain: %d vertices, built in %.3f ms",
+			    std::any_cast<int>(parameters.at("far_terrain_vertices")),
+			    std::any_cast<float>(parameters.at("far_terrain_build_time")));
+		    }
+		    ImGui::Text("Quad arena: %d/%d quads used, %d free ranges",
+			std::any_cast<int>(parameters.at("render_arena_used")),
+			std::any_cast<int>(parameters.at("render_arena_capacity")),
+			std::any_cast<int>(parameters.at("render_arena_free_ranges")));
+		    ImGui::SliderFloat("Upload budget (ms)",
+			    std::any_cast<float*>(parameters.at("upload_budget_return")), 0.1f, 16.0f);
+		    ImGui::Text("Upload backlog: %d (%d uploads, %d deletions this frame)",
+			std::any_cast<int>(parameters.at("render_upload_backlog")),
+			std::any_cast<int>(parameters.at("render_uploads_frame")),
+			std::any_cast<int>(parameters.at("render_deletes_frame")));
+		    ImGui::Text("Upload time (ms): %f, budget overruns: %d",
+			std::any_cast<float>(parameters.at("render_upload_time")),
+			std::any_cast<int>(parameters.at("render_upload_overruns")));
+		    ImGui::Text("Upload ring: %d bytes this frame, %d stalls",
+			std::any_cast<int>(parameters.at("render_ring_used")),
+			std::any_cast<int>(parameters.at("render_ring_stalls")));
+		    ImGui::Text("Mesh data objects available: %d",
+			std::any_cast<int>(parameters.at("mesh_pool_available")));
+		    if(parameters.find("mesh_pool_exhausted") != parameters.end())
+			ImGui::Text("Mesh data pool exhausted: %d times",
+			    std::any_cast<int>(parameters.at("mesh_pool_exhausted")));
 		    ImGui::Checkbox("Wireframe",
 			    std::any_cast<bool*>(parameters.at("wireframe_return")));
+		    ImGui::Checkbox("Geometry shader quads (fallback)",
+			    std::any_cast<bool*>(parameters.at("geometry_shader_return")));
 		}
 
 		if(ImGui::CollapsingHeader("Chunks")){
@@ -123,6 +215,41 @@ namespace debug{
 			std::any_cast<int>(parameters.at("update_chunks_freed")));
 		    ImGui::Text("Chunks explored: %d",
 			std::any_cast<int>(parameters.at("update_chunks_explored")));
+		    ImGui::Text("Level of detail changes: %d",
+			std::any_cast<int>(parameters.at("update_chunks_lod_switches")));
+		    ImGui::Text("Chunks in the render volume: %d",
+			std::any_cast<int>(parameters.at("update_chunks_volume")));
+		    ImGui::Text("Generation jobs: %d queued, %d done, %d stale, %d deferred",
+			std::any_cast<int>(parameters.at("jobs_generation_queued")),
+			std::any_cast<int>(parameters.at("jobs_generation_done")),
+			std::any_cast<int>(parameters.at("jobs_generation_stale")),
+			std::any_cast<int>(parameters.at("jobs_generation_deferred")));
+		    ImGui::Text("Meshing jobs: %d queued, %d done, %d stale, %d deferred",
+			std::any_cast<int>(parameters.at("jobs_meshing_queued")),
+			std::any_cast<int>(parameters.at("jobs_meshing_done")),
+			std::any_cast<int>(parameters.at("jobs_meshing_stale")),
+			std::any_cast<int>(parameters.at("jobs_meshing_deferred")));
+		    ImGui::Text("Meshing jobs sent by neighbour generation: %d",
+			std::any_cast<int>(parameters.at("jobs_meshing_triggered")));
+		    if(parameters.find("nav_paths_found") != parameters.end())
+			ImGui::Text("Paths: %d found, %d failed, last in %.2f ms, %d chunks summarized",
+			    std::any_cast<int>(parameters.at("nav_paths_found")),
+			    std::any_cast<int>(parameters.at("nav_paths_failed")),
+			    std::any_cast<float>(parameters.at("nav_last_time")),
+			    std::any_cast<int>(parameters.at("nav_chunks_built")));
+		    {
+			const int hits = std::any_cast<int>(parameters.at("prefetch_hits"));
+			const int late = std::any_cast<int>(parameters.at("prefetch_late"));
+			const int wasted = std::any_cast<int>(parameters.at("prefetch_wasted"));
+			ImGui::Text("Prefetched chunks: %d requested, %d pending",
+			    std::any_cast<int>(parameters.at("prefetch_requested")),
+			    std::any_cast<int>(parameters.at("prefetch_pending")));
+			ImGui::Text("Prefetch hits: %d, late: %d, wasted: %d (hit rate %.1f%%)", hits, late,
+			    wasted, hits + late + wasted > 0 ? 100.0f * hits / (hits + late + wasted) : 0.0f);
+		    }
+		    slider_atomic("Render distance", "render_distance_return", 2, 32);
+		    slider_atomic("Render height", "render_height_return", 1, 16);
+		    combo_atomic("Render volume shape", "render_shape_return", "Cube\0Cylinder\0Sphere\0");
 		}
 	    }catch(const std::bad_any_cast& e){
 		std::cout << e.what() << std::endl;
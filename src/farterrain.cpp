@@ -0,0 +1,214 @@
+#include "farterrain.hpp"
+
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "block.hpp"
+#include "chunk.hpp"
+#include "chunkgenerator.hpp"
+#include "chunkmanager.hpp"
+#include "debugwindow.hpp"
+#include "globals.hpp"
+#include "shader.hpp"
+
+namespace farterrain{
+    typedef struct FarVertex{
+	glm::vec3 position;
+	glm::vec3 normal;
+    } FarVertex;
+
+    // Rings need to line up with each other, so they are centered on a multiple of the biggest cell
+    constexpr int SNAP = FAR_TERRAIN_CELL_SIZE << (FAR_TERRAIN_RINGS - 1);
+    static_assert(CHUNK_SIZE % FAR_TERRAIN_CELL_SIZE == 0, "Far terrain cells must not cross chunk borders");
+
+    Shader* farShader;
+    GLuint farVAO, farVBO, farEBO;
+    GLsizei num_indices{0};
+
+    /* Building */
+    std::thread build_thread;
+    std::mutex build_mutex;
+    std::condition_variable build_cv;
+    bool build_requested{false}, build_ready{false}, build_stop{false};
+    // Chunk the player was in and render volume when the last build was requested
+    glm::ivec3 build_chunk{INT32_MAX}, requested_chunk;
+    std::shared_ptr<const chunkmanager::RenderVolume> build_volume;
+    std::vector<FarVertex> vertices;
+    std::vector<GLuint> indices;
+    double build_time{0};
+
+    void build();
+
+    void init(){
+	farShader = new Shader{nullptr, "shaders/shader-far.vs", "shaders/shader-texture.fs"};
+	farShader->use();
+	farShader->setFloat("textureScale", FAR_TERRAIN_TEXTURE_SCALE);
+	farShader->setFloat("grassLayer", static_cast<float>(static_cast<int>(Block::GRASS) - 2));
+
+	glGenVertexArrays(1, &farVAO);
+	glGenBuffers(1, &farVBO);
+	glGenBuffers(1, &farEBO);
+	glBindVertexArray(farVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, farVBO);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, farEBO);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(FarVertex), (void*)offsetof(FarVertex, position));
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(FarVertex), (void*)offsetof(FarVertex, normal));
+	glEnableVertexAttribArray(1);
+	glBindVertexArray(0);
+
+	build_thread = std::thread(build);
+    }
+
+    void update(glm::vec3 cameraPos){
+	glm::ivec3 chunk = glm::floor(cameraPos / static_cast<float>(CHUNK_SIZE));
+
+	std::unique_lock<std::mutex> lock(build_mutex, std::try_to_lock);
+	// The builder is busy, try again next frame
+	if(!lock.owns_lock()) return;
+
+	if(build_ready){
+	    glBindBuffer(GL_ARRAY_BUFFER, farVBO);
+	    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(FarVertex), vertices.data(), GL_STATIC_DRAW);
+	    glBindBuffer(GL_ARRAY_BUFFER, 0);
+	    glBindVertexArray(farVAO);
+	    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+	    glBindVertexArray(0);
+	    num_indices = indices.size();
+	    build_ready = false;
+
+	    debug::window::set_parameter("far_terrain_vertices", (int)vertices.size());
+	    debug::window::set_parameter("far_terrain_build_time", (float)(build_time * 1000.0));
+	}
+
+	// The voxel region moves with every chunk
+	const auto volume = chunkmanager::getRenderVolume();
+	if(volume != nullptr && !build_requested && (chunk != build_chunk || volume != build_volume)){
+	    build_chunk = chunk;
+	    build_volume = volume;
+	    requested_chunk = chunk;
+	    build_requested = true;
+	    lock.unlock();
+	    build_cv.notify_all();
+	}
+    }
+
+    void render(const glm::mat4& view, const glm::mat4& projection, glm::vec3 cameraPos){
+	if(num_indices == 0) return;
+
+	farShader->use();
+	farShader->setMat4("view", view);
+	farShader->setMat4("projection", projection);
+	farShader->setVec3("viewPos", cameraPos);
+	glBindVertexArray(farVAO);
+	glDrawElements(GL_TRIANGLES, num_indices, GL_UNSIGNED_INT, 0);
+	glBindVertexArray(0);
+    }
+
+    // Append a ring to the heightfield. Cells for which skip returns true are left out
+    template<typename F>
+    void build_ring(glm::ivec2 center, int cell, int half_extent, F skip){
+	const int n = 2 * half_extent / cell;
+	const glm::ivec2 origin = center - half_extent;
+	const GLuint base = vertices.size();
+
+	std::vector<float> heights((n + 1) * (n + 1));
+	for(int i = 0; i <= n; i++)
+	    for(int j = 0; j <= n; j++)
+		// The surface is the top of the grass block
+		heights[i * (n + 1) + j] = terrainHeight(origin.x + i * cell, origin.y + j * cell) + 1;
+
+	// The next ring has cells twice as big. Vertices on the outer border that the next ring
+	// doesn't have are moved onto its edges, so that no cracks open between the two
+	for(int k = 1; k < n; k += 2){
+	    for(int side : {0, n}){
+		float* h = &heights[side * (n + 1)];
+		h[k] = (h[k - 1] + h[k + 1]) * 0.5f;
+		h = &heights[side];
+		h[k * (n + 1)] = (h[(k - 1) * (n + 1)] + h[(k + 1) * (n + 1)]) * 0.5f;
+	    }
+	}
+
+	auto height = [&](int i, int j){
+	    return heights[glm::clamp(i, 0, n) * (n + 1) + glm::clamp(j, 0, n)];
+	};
+	for(int i = 0; i <= n; i++)
+	    for(int j = 0; j <= n; j++){
+		glm::vec3 normal(height(i - 1, j) - height(i + 1, j), 2.0f * cell, height(i, j - 1) -
+			height(i, j + 1));
+		vertices.push_back({glm::vec3(origin.x + i * cell, height(i, j), origin.y + j * cell),
+			glm::normalize(normal)});
+	    }
+
+	for(int i = 0; i < n; i++)
+	    for(int j = 0; j < n; j++){
+		glm::ivec2 min = origin + glm::ivec2(i, j) * cell;
+		if(skip(min, min + cell)) continue;
+
+		const GLuint v = base + i * (n + 1) + j;
+		indices.insert(indices.end(), {v, v + 1, v + n + 1, v + 1, v + n + 2, v + n + 1});
+	    }
+    }
+
+    void build(){
+	std::unique_lock<std::mutex> lock(build_mutex);
+	while(true){
+	    build_cv.wait(lock, []{ return build_requested || build_stop; });
+	    if(build_stop) break;
+
+	    const double start = glfwGetTime();
+	    vertices.clear();
+	    indices.clear();
+
+	    // The first ring reaches at least a chunk past the voxel region, the others double in
+	    // size each time
+	    const int base = ((build_volume->distance + 1) * CHUNK_SIZE + SNAP - 1) / SNAP * SNAP;
+	    const glm::ivec2 camera(requested_chunk.x * CHUNK_SIZE, requested_chunk.z * CHUNK_SIZE);
+	    const glm::ivec2 center = glm::ivec2(glm::round(glm::vec2(camera) / static_cast<float>(SNAP))) * SNAP;
+
+	    for(int r = 0; r < FAR_TERRAIN_RINGS; r++){
+		const int cell = FAR_TERRAIN_CELL_SIZE << r;
+		const int inner = r == 0 ? 0 : base << r;
+		const int outer = base << (r + 1);
+
+		build_ring(center, cell, outer, [&](glm::ivec2 min, glm::ivec2 max){
+			// The first ring goes up to the voxels. Cells don't cross chunk borders, so
+			// each one is either over a voxel chunk holding the surface or not
+			if(r == 0){
+			    glm::ivec2 column = glm::floor(glm::vec2(min) / static_cast<float>(CHUNK_SIZE));
+			    int surface = glm::floor(static_cast<float>(terrainHeight(min.x, min.y)) / CHUNK_SIZE);
+			    return build_volume->contains(column.x - requested_chunk.x, surface -
+				    requested_chunk.y, column.y - requested_chunk.z);
+			}
+			// The others up to the previous ring
+			return glm::all(glm::greaterThanEqual(min, center - inner)) &&
+			    glm::all(glm::lessThanEqual(max, center + inner));
+			});
+	    }
+
+	    build_time = glfwGetTime() - start;
+	    build_requested = false;
+	    build_ready = true;
+	}
+    }
+
+    void destroy(){
+	{
+	    std::lock_guard<std::mutex> lock(build_mutex);
+	    build_stop = true;
+	}
+	build_cv.notify_all();
+	build_thread.join();
+
+	glDeleteBuffers(1, &farVBO);
+	glDeleteBuffers(1, &farEBO);
+	glDeleteVertexArrays(1, &farVAO);
+	delete farShader;
+    }
+};
@@ -0,0 +1,142 @@
+#include "heightmap.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <map>
+
+#include <oneapi/tbb/concurrent_hash_map.h>
+
+#include "globals.hpp"
+
+namespace heightmap{
+    typedef struct Column{
+	Column(){ height.fill(HEIGHTMAP_NONE); }
+
+	// World y of the highest non-air block of each column of blocks, indexed like ChunkHeights
+	std::array<int32_t, CHUNK_SIZE * CHUNK_SIZE> height;
+	// Heights inside each generated chunk of the column that is not all air, from the top down
+	std::map<int, ChunkHeights, std::greater<int>> chunks;
+    } Column;
+
+    // Columns of chunks, keyed by cx | cz << 10 like the chunk indices. The accessor locks the
+    // whole column
+    typedef oneapi::tbb::concurrent_hash_map<chunk_index_t, Column> ColumnTable;
+    ColumnTable columns;
+
+    chunk_index_t columnIndex(int cx, int cz){ return cx | (cz << 10); }
+
+    bool solid(Block b){ return b != Block::AIR && b != Block::NULLBLK; }
+
+    // Whether height h belongs to chunk cy of the column
+    bool inChunk(int32_t h, int cy){ return h != HEIGHTMAP_NONE && h / CHUNK_SIZE == cy; }
+
+    // Height of column i from the highest chunk that has something in it. Only needed when the
+    // block at the top goes away
+    void refresh(Column& col, int i){
+	col.height[i] = HEIGHTMAP_NONE;
+	for(const auto& [cy, heights] : col.chunks)
+	    if(heights[i] >= 0){
+		col.height[i] = cy * CHUNK_SIZE + heights[i];
+		return;
+	    }
+    }
+
+    int getHeight(int x, int z){
+	if(x < 0 || z < 0 || x >= 1024 * CHUNK_SIZE || z >= 1024 * CHUNK_SIZE) return HEIGHTMAP_NONE;
+
+	ColumnTable::const_accessor a;
+	if(!columns.find(a, columnIndex(x / CHUNK_SIZE, z / CHUNK_SIZE))) return HEIGHTMAP_NONE;
+	return a->second.height[(x % CHUNK_SIZE) * CHUNK_SIZE + z % CHUNK_SIZE];
+    }
+
+    bool getHeights(int cx, int cz, int32_t* heights){
+	ColumnTable::const_accessor a;
+	if(!columns.find(a, columnIndex(cx, cz))) return false;
+	std::copy(a->second.height.begin(), a->second.height.end(), heights);
+	return true;
+    }
+
+    void setChunk(glm::ivec3 chunk, const ChunkHeights& heights){
+	const bool empty = std::all_of(heights.begin(), heights.end(), [](int8_t h){ return h < 0; });
+
+	ColumnTable::accessor a;
+	if(empty){
+	    // All air chunks are not kept, there might be nothing to do
+	    if(!columns.find(a, columnIndex(chunk.x, chunk.z))) return;
+	}else columns.insert(a, columnIndex(chunk.x, chunk.z));
+
+	Column& col = a->second;
+	if(empty) col.chunks.erase(chunk.y);
+	else col.chunks[chunk.y] = heights;
+
+	for(int i = 0; i < CHUNK_SIZE * CHUNK_SIZE; i++){
+	    const int32_t h = chunk.y * CHUNK_SIZE + heights[i];
+	    if(heights[i] >= 0 && h >= col.height[i]) col.height[i] = h;
+	    else if(inChunk(col.height[i], chunk.y)) refresh(col, i);
+	}
+
+	if(col.chunks.empty()) columns.erase(a);
+    }
+
+    void updateChunk(Chunk::Chunk* c){
+	ChunkHeights heights;
+	heights.fill(-1);
+	c->getBlocks().forEachRun(0, CHUNK_VOLUME, [&](int start, int end, Block b){
+	    if(!solid(b)) return;
+	    for(int h = start; h < end; h++){
+		int8_t& top = heights[HILBERT_XYZ_DECODE[h][0] * CHUNK_SIZE + HILBERT_XYZ_DECODE[h][2]];
+		top = std::max<int8_t>(top, HILBERT_XYZ_DECODE[h][1]);
+	    }
+	});
+	setChunk(glm::ivec3(c->getPosition()), heights);
+    }
+
+    void setBlock(Chunk::Chunk* c, int x, int y, int z, Block b){
+	const glm::ivec3 chunk(c->getPosition());
+	const int i = x * CHUNK_SIZE + z;
+
+	ColumnTable::accessor a;
+	if(solid(b)) columns.insert(a, columnIndex(chunk.x, chunk.z));
+	else if(!columns.find(a, columnIndex(chunk.x, chunk.z))) return;
+	Column& col = a->second;
+
+	auto it = col.chunks.find(chunk.y);
+	if(it == col.chunks.end()){
+	    if(!solid(b)) return;
+	    ChunkHeights heights;
+	    heights.fill(-1);
+	    it = col.chunks.emplace(chunk.y, heights).first;
+	}
+
+	int8_t& top = it->second[i];
+	if(solid(b)){
+	    if(y <= top) return;
+	    top = y;
+	}else{
+	    if(y != top) return;
+	    // The top block went away, the next one is somewhere below
+	    top = -1;
+	    for(int ly = y - 1; ly >= 0; ly--)
+		if(solid(c->getBlock(x, ly, z))){
+		    top = ly;
+		    break;
+		}
+	}
+
+	const int32_t h = chunk.y * CHUNK_SIZE + top;
+	if(top >= 0 && h >= col.height[i]) col.height[i] = h;
+	else if(inChunk(col.height[i], chunk.y)) refresh(col, i);
+    }
+
+    void removeChunk(glm::ivec3 chunk){
+	ColumnTable::accessor a;
+	if(!columns.find(a, columnIndex(chunk.x, chunk.z))) return;
+	Column& col = a->second;
+	if(col.chunks.erase(chunk.y) == 0) return;
+
+	for(int i = 0; i < CHUNK_SIZE * CHUNK_SIZE; i++)
+	    if(inChunk(col.height[i], chunk.y)) refresh(col, i);
+
+	if(col.chunks.empty()) columns.erase(a);
+    }
+};
@@ -9,6 +9,8 @@
 #include "chunkmanager.hpp"
 #include "controls.hpp"
 #include "debugwindow.hpp"
+#include "heightmap.hpp"
+#include "navigation.hpp"
 #include "renderer.hpp"
 #include "shader.hpp"
 #include "spacefilling.hpp"
@@ -67,6 +69,7 @@ int main()
     controls::init();
     chunkmanager::init();
     chunkmesher::init();
+    navigation::init();
     debug::window::init(window);
     renderer::init(window);
 
@@ -107,6 +110,8 @@ int main()
 	debug::window::set_parameter("cx", (int)(theCamera.getPos().x / CHUNK_SIZE));
 	debug::window::set_parameter("cy", (int)(theCamera.getPos().y / CHUNK_SIZE));
 	debug::window::set_parameter("cz", (int)(theCamera.getPos().z / CHUNK_SIZE));
+	debug::window::set_parameter("surface_height", heightmap::getHeight(std::floor(theCamera.getPos().x),
+		    std::floor(theCamera.getPos().z)));
 	debug::window::set_parameter("lx", theCamera.getFront().x);
 	debug::window::set_parameter("ly", theCamera.getFront().y);
 	debug::window::set_parameter("lz", theCamera.getFront().z);
@@ -120,6 +125,7 @@ int main()
     }
 
     // Stop threads and wait for them to finish
+    navigation::stop();
     chunkmanager::stop();
 
     // Cleanup allocated memory
@@ -0,0 +1,442 @@
+#include "navigation.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <set>
+#include <queue>
+#include <shared_mutex>
+#include <thread>
+#include <unordered_map>
+
+#include <oneapi/tbb/concurrent_queue.h>
+
+#include "chunkmanager.hpp"
+#include "debugwindow.hpp"
+
+namespace navigation{
+    typedef struct PathRequest{
+	glm::ivec3 start, goal;
+	std::promise<Path> result;
+    } PathRequest;
+
+    oneapi::tbb::concurrent_bounded_queue<PathRequest*> requests;
+    std::vector<std::thread> workers;
+
+    // Summaries of the chunks. Invalidations are numbered, and each chunk is stamped with the last
+    // one that touched it: a summary built while its chunk was being invalidated is not kept.
+    // Stamps older than every build in progress can't throw anything away anymore, they are pruned
+    std::unordered_map<chunk_index_t, std::shared_ptr<const NavChunk>> nav_chunks;
+    std::unordered_map<chunk_index_t, uint64_t> stamps;
+    // Number of the last invalidation when each build in progress started
+    std::multiset<uint64_t> building;
+    uint64_t invalidations{0};
+    std::shared_mutex nav_mutex;
+
+    std::atomic_int paths_found{0}, paths_failed{0}, chunks_built{0};
+
+    // Directions an agent can walk in
+    const glm::ivec3 directions[4]{{1, 0, 0}, {-1, 0, 0}, {0, 0, 1}, {0, 0, -1}};
+
+    uint64_t key(glm::ivec3 p){
+	return (uint64_t)(p.x & 0x1FFFFF) << 42 | (uint64_t)(p.y & 0x1FFFFF) << 21 | (uint64_t)(p.z &
+		0x1FFFFF);
+    }
+
+    int cellIndex(glm::ivec3 l){ return l.x + l.y * CHUNK_SIZE + l.z * CHUNK_SIZE * CHUNK_SIZE; }
+
+    bool inChunk(glm::ivec3 l){
+	return !glm::any(glm::lessThan(l, glm::ivec3(0))) && !glm::any(glm::greaterThanEqual(l,
+		    glm::ivec3(CHUNK_SIZE)));
+    }
+
+    glm::ivec3 chunkOf(glm::ivec3 p){
+	return glm::ivec3(glm::floor(glm::vec3(p) / static_cast<float>(CHUNK_SIZE)));
+    }
+
+    bool lessThan(glm::ivec3 u, glm::ivec3 v){
+	return u.x != v.x ? u.x < v.x : u.y != v.y ? u.y < v.y : u.z < v.z;
+    }
+
+    int chebyshev(glm::ivec3 u, glm::ivec3 v){
+	const glm::ivec3 d = glm::abs(u - v);
+	return std::max({d.x, d.y, d.z});
+    }
+
+    // Breadth first search inside a chunk, from a block in chunk coordinates. dist and parent are
+    // indexed like the bitsets of the chunk, blocks that can't be reached have dist -1
+    void localSearch(const NavChunk& nav, glm::ivec3 start, std::vector<int>& dist,
+	    std::vector<int>& parent){
+	thread_local std::vector<int> queue;
+	dist.assign(CHUNK_VOLUME, -1);
+	parent.resize(CHUNK_VOLUME);
+	queue.clear();
+
+	const int s = cellIndex(start);
+	dist[s] = 0;
+	parent[s] = -1;
+	queue.push_back(s);
+
+	for(size_t i = 0; i < queue.size(); i++){
+	    const int c = queue[i];
+	    const glm::ivec3 l(c % CHUNK_SIZE, (c / CHUNK_SIZE) % CHUNK_SIZE, c / (CHUNK_SIZE *
+			CHUNK_SIZE));
+	    for(const auto& d : directions)
+		for(int dy = -1; dy <= 1; dy++){
+		    const glm::ivec3 n = l + d + glm::ivec3(0, dy, 0);
+		    if(!inChunk(n)) continue;
+		    const int ni = cellIndex(n);
+		    if(dist[ni] >= 0 || !nav.walkable[ni]) continue;
+		    // Stepping up needs room to jump where the agent is, stepping down where it lands
+		    if(dy > 0 && !nav.headroom[c]) continue;
+		    if(dy < 0 && !nav.headroom[ni]) continue;
+
+		    dist[ni] = dist[c] + 1;
+		    parent[ni] = c;
+		    queue.push_back(ni);
+		}
+	}
+    }
+
+    // Append the blocks from the start of the last local search to to, start excluded
+    void appendLocalPath(const NavChunk& nav, const std::vector<int>& parent, glm::ivec3 to, Path&
+	    path){
+	const glm::ivec3 origin = nav.position * CHUNK_SIZE;
+	const size_t first = path.size();
+	for(int c = cellIndex(to - origin); parent[c] >= 0; c = parent[c])
+	    path.push_back(origin + glm::ivec3(c % CHUNK_SIZE, (c / CHUNK_SIZE) % CHUNK_SIZE, c /
+			(CHUNK_SIZE * CHUNK_SIZE)));
+	std::reverse(path.begin() + first, path.end());
+    }
+
+    std::shared_ptr<const NavChunk> build(glm::ivec3 chunk){
+	// The chunk with a margin around it: one block on the sides for the blocks an agent can walk
+	// out to, two below and two above for the ground and the headroom of those blocks
+	const glm::ivec3 margin_min(-1, -2, -1), margin_max(CHUNK_SIZE, CHUNK_SIZE + 1, CHUNK_SIZE);
+	const glm::ivec3 size = margin_max - margin_min + 1;
+	const glm::ivec3 origin = chunk * CHUNK_SIZE;
+
+	std::vector<Block> blocks(size.x * size.y * size.z);
+	chunkmanager::getBlocksInRegion(origin + margin_min, origin + margin_max, blocks.data());
+
+	// In chunk coordinates. Blocks that are not loaded are solid
+	const glm::ivec3 up(0, 1, 0);
+	auto solid = [&](glm::ivec3 l){
+	    const glm::ivec3 r = l - margin_min;
+	    return blocks[(r.x * size.y + r.y) * size.z + r.z] != Block::AIR;
+	};
+	auto walkable = [&](glm::ivec3 l){ return solid(l - up) && !solid(l) && !solid(l + up); };
+	auto headroom = [&](glm::ivec3 l){ return !solid(l + up * 2); };
+	auto canMove = [&](glm::ivec3 from, glm::ivec3 to){
+	    if(!walkable(to)) return false;
+	    if(to.y > from.y) return headroom(from);
+	    if(to.y < from.y) return headroom(to);
+	    return true;
+	};
+
+	auto nav = std::make_shared<NavChunk>();
+	nav->position = chunk;
+
+	// Moves out of the chunk, (inside, outside) in world coordinates, grouped by the chunk they
+	// lead to
+	std::map<chunk_index_t, std::vector<std::pair<glm::ivec3, glm::ivec3>>> transitions;
+	for(int x = 0; x < CHUNK_SIZE; x++)
+	for(int y = 0; y < CHUNK_SIZE; y++)
+	for(int z = 0; z < CHUNK_SIZE; z++){
+	    const glm::ivec3 l(x, y, z);
+	    if(!walkable(l)) continue;
+	    nav->walkable.set(cellIndex(l));
+	    if(headroom(l)) nav->headroom.set(cellIndex(l));
+
+	    if(x > 0 && x < CHUNK_SIZE - 1 && y > 0 && y < CHUNK_SIZE - 1 && z > 0 && z < CHUNK_SIZE
+		    - 1) continue;
+	    for(const auto& d : directions)
+		for(int dy = -1; dy <= 1; dy++){
+		    const glm::ivec3 n = l + d + glm::ivec3(0, dy, 0);
+		    if(inChunk(n) || !canMove(l, n)) continue;
+
+		    const glm::ivec3 c = chunkOf(origin + n);
+		    if(glm::any(glm::lessThan(c, glm::ivec3(0))) || glm::any(glm::greaterThan(c,
+				    glm::ivec3(1023)))) continue;
+		    transitions[Chunk::calculateIndex(c.x, c.y, c.z)].emplace_back(origin + l, origin +
+			    n);
+		}
+	}
+
+	std::unordered_map<uint64_t, int> portal_index;
+	auto portal = [&](glm::ivec3 p){
+	    const auto [i, inserted] = portal_index.try_emplace(key(p), nav->portals.size());
+	    if(inserted){
+		nav->portals.push_back(p);
+		nav->edges.emplace_back();
+	    }
+	    return i->second;
+	};
+
+	// The chunk on the other side finds the same moves, the other way around. Moves next to each
+	// other make up an entrance, with a single portal in the middle. The order the moves are
+	// considered in doesn't depend on the side, so both chunks agree on the portals
+	for(auto& [index, moves] : transitions){
+	    std::vector<std::pair<glm::ivec3, glm::ivec3>> canonical(moves.size());
+	    for(size_t i = 0; i < moves.size(); i++){
+		canonical[i] = moves[i];
+		if(lessThan(moves[i].second, moves[i].first))
+		    std::swap(canonical[i].first, canonical[i].second);
+	    }
+	    std::vector<int> order(moves.size());
+	    std::iota(order.begin(), order.end(), 0);
+	    std::sort(order.begin(), order.end(), [&](int u, int v){
+		    const auto& a = canonical[u];
+		    const auto& b = canonical[v];
+		    return a.first != b.first ? lessThan(a.first, b.first) : lessThan(a.second,
+			    b.second);
+	    });
+
+	    std::vector<int> root(moves.size());
+	    std::iota(root.begin(), root.end(), 0);
+	    std::function<int(int)> find = [&](int i){ return root[i] == i ? i : root[i] =
+		find(root[i]); };
+	    for(size_t i = 0; i < order.size(); i++)
+		for(size_t j = i + 1; j < order.size(); j++){
+		    const auto& a = canonical[order[i]];
+		    const auto& b = canonical[order[j]];
+		    if(chebyshev(a.first, b.first) <= 1 && chebyshev(a.second, b.second) <= 1)
+			root[find(i)] = find(j);
+		}
+
+	    std::map<int, std::vector<int>> entrances;
+	    for(size_t i = 0; i < order.size(); i++) entrances[find(i)].push_back(order[i]);
+	    for(const auto& [r, members] : entrances){
+		const auto& move = moves[members[members.size() / 2]];
+		nav->edges[portal(move.first)].push_back({move.second, 1});
+	    }
+	}
+
+	// Walking distance between the portals of the chunk
+	std::vector<int> dist, parent;
+	for(size_t i = 0; i < nav->portals.size(); i++){
+	    localSearch(*nav, nav->portals[i] - origin, dist, parent);
+	    for(size_t j = 0; j < nav->portals.size(); j++){
+		const int d = dist[cellIndex(nav->portals[j] - origin)];
+		if(i != j && d >= 0) nav->edges[i].push_back({nav->portals[j], d});
+	    }
+	}
+
+	chunks_built++;
+	return nav;
+    }
+
+    std::shared_ptr<const NavChunk> get(glm::ivec3 chunk){
+	if(glm::any(glm::lessThan(chunk, glm::ivec3(0))) || glm::any(glm::greaterThan(chunk,
+			glm::ivec3(1023)))) return nullptr;
+	const chunk_index_t index = Chunk::calculateIndex(chunk.x, chunk.y, chunk.z);
+
+	{
+	    std::shared_lock<std::shared_mutex> lock(nav_mutex);
+	    const auto n = nav_chunks.find(index);
+	    if(n != nav_chunks.end()) return n->second;
+	}
+
+	uint64_t started{0};
+	{
+	    std::unique_lock<std::shared_mutex> lock(nav_mutex);
+	    started = invalidations;
+	    building.insert(started);
+	}
+
+	std::shared_ptr<const NavChunk> nav = build(chunk);
+
+	std::unique_lock<std::shared_mutex> lock(nav_mutex);
+	building.erase(building.find(started));
+	const auto s = stamps.find(index);
+	if(s == stamps.end() || s->second <= started) nav_chunks[index] = nav;
+	return nav;
+    }
+
+    void invalidate(glm::ivec3 chunk){
+	std::unique_lock<std::shared_mutex> lock(nav_mutex);
+	invalidations++;
+	// Moves can lead to the chunks on the diagonals too
+	for(int x = -1; x <= 1; x++)
+	for(int y = -1; y <= 1; y++)
+	for(int z = -1; z <= 1; z++){
+	    const glm::ivec3 c = chunk + glm::ivec3(x, y, z);
+	    if(glm::any(glm::lessThan(c, glm::ivec3(0))) || glm::any(glm::greaterThan(c,
+			    glm::ivec3(1023)))) continue;
+	    const chunk_index_t index = Chunk::calculateIndex(c.x, c.y, c.z);
+	    nav_chunks.erase(index);
+	    stamps[index] = invalidations;
+	}
+
+	if(stamps.size() > NAVIGATION_MAX_STAMPS){
+	    const uint64_t oldest = building.empty() ? invalidations : *building.begin();
+	    for(auto s = stamps.begin(); s != stamps.end();){
+		if(s->second <= oldest) s = stamps.erase(s);
+		else s++;
+	    }
+	}
+    }
+
+    Path search(glm::ivec3 start, glm::ivec3 goal){
+	const auto start_chunk = get(chunkOf(start));
+	const auto goal_chunk = get(chunkOf(goal));
+	if(!start_chunk || !goal_chunk) return {};
+
+	const glm::ivec3 start_origin = start_chunk->position * CHUNK_SIZE;
+	const glm::ivec3 goal_origin = goal_chunk->position * CHUNK_SIZE;
+	if(!start_chunk->walkable[cellIndex(start - start_origin)] ||
+		!goal_chunk->walkable[cellIndex(goal - goal_origin)]) return {};
+
+	thread_local std::vector<int> dist, parent, goal_dist, goal_parent;
+	Path path{start};
+
+	// Both in the same chunk, most of the times there is a way without leaving it
+	localSearch(*start_chunk, start - start_origin, dist, parent);
+	if(start_chunk->position == goal_chunk->position && dist[cellIndex(goal - goal_origin)] >= 0){
+	    appendLocalPath(*start_chunk, parent, goal, path);
+	    return path;
+	}
+	// Moves go both ways, so this gives the distance from the portals to the goal
+	localSearch(*goal_chunk, goal - goal_origin, goal_dist, goal_parent);
+
+	// A* over the portals. The start and the goal are extra nodes, linked to the portals of their
+	// chunk
+	typedef struct Node{
+	    glm::ivec3 position;
+	    int g{INT_MAX};
+	    uint64_t parent;
+	    bool closed{false};
+	} Node;
+	const uint64_t START = ~0ULL, GOAL = ~1ULL;
+	std::unordered_map<uint64_t, Node> nodes;
+	std::priority_queue<std::pair<int, uint64_t>, std::vector<std::pair<int, uint64_t>>,
+	    std::greater<std::pair<int, uint64_t>>> open;
+
+	// A step changes x or z by one, and y by one at most
+	auto h = [&](glm::ivec3 p){
+	    const glm::ivec3 d = glm::abs(goal - p);
+	    return std::max(d.x + d.z, d.y);
+	};
+	auto relax = [&](uint64_t k, glm::ivec3 p, int g, uint64_t from){
+	    Node& n = nodes[k];
+	    if(n.closed || g >= n.g) return;
+	    n.position = p;
+	    n.g = g;
+	    n.parent = from;
+	    open.emplace(g + h(p), k);
+	};
+
+	nodes[START] = Node{start, 0, START, true};
+	for(const auto& p : start_chunk->portals){
+	    const int d = dist[cellIndex(p - start_origin)];
+	    if(d >= 0) relax(key(p), p, d, START);
+	}
+
+	int expansions{0};
+	bool found{false};
+	while(!open.empty() && expansions < NAVIGATION_MAX_EXPANSIONS){
+	    const uint64_t k = open.top().second;
+	    open.pop();
+	    if(k == GOAL){
+		found = true;
+		break;
+	    }
+
+	    Node& n = nodes[k];
+	    if(n.closed) continue;
+	    n.closed = true;
+	    expansions++;
+	    const glm::ivec3 position = n.position;
+	    const int g = n.g;
+
+	    const auto nav = get(chunkOf(position));
+	    if(!nav) continue;
+	    if(nav->position == goal_chunk->position){
+		const int d = goal_dist[cellIndex(position - goal_origin)];
+		if(d >= 0) relax(GOAL, goal, g + d, k);
+	    }
+
+	    const auto i = std::find(nav->portals.begin(), nav->portals.end(), position);
+	    if(i == nav->portals.end()) continue;
+	    for(const auto& e : nav->edges[i - nav->portals.begin()])
+		relax(key(e.to), e.to, g + e.cost, k);
+	}
+	if(!found) return {};
+
+	// Portals from the start to the goal
+	std::vector<glm::ivec3> waypoints;
+	for(uint64_t k = GOAL; k != START; k = nodes[k].parent) waypoints.push_back(nodes[k].position);
+	waypoints.push_back(start);
+	std::reverse(waypoints.begin(), waypoints.end());
+
+	// Refine: walk inside the chunks, portals linking two chunks are next to each other
+	for(size_t i = 1; i < waypoints.size(); i++){
+	    const glm::ivec3 from = waypoints[i - 1], to = waypoints[i];
+	    if(chunkOf(from) != chunkOf(to)){
+		path.push_back(to);
+		continue;
+	    }
+
+	    const auto nav = get(chunkOf(from));
+	    if(!nav) return {};
+	    localSearch(*nav, from - nav->position * CHUNK_SIZE, dist, parent);
+	    if(dist[cellIndex(to - nav->position * CHUNK_SIZE)] < 0) return {};
+	    appendLocalPath(*nav, parent, to, path);
+	}
+
+	return path;
+    }
+
+    Path findPath(glm::ivec3 start, glm::ivec3 goal){
+	const auto begin = std::chrono::steady_clock::now();
+	Path path = search(start, goal);
+	const double elapsed = std::chrono::duration<double, std::milli>(
+		std::chrono::steady_clock::now() - begin).count();
+
+	if(path.empty()) paths_failed++;
+	else paths_found++;
+	debug::window::set_parameter("nav_paths_found", (int)paths_found);
+	debug::window::set_parameter("nav_paths_failed", (int)paths_failed);
+	debug::window::set_parameter("nav_chunks_built", (int)chunks_built);
+	debug::window::set_parameter("nav_last_time", (float)elapsed);
+	return path;
+    }
+
+    void work(){
+	while(true){
+	    PathRequest* request{nullptr};
+	    requests.pop(request);
+	    // Shutting down
+	    if(request == nullptr) break;
+	    request->result.set_value(findPath(request->start, request->goal));
+	    delete request;
+	}
+    }
+
+    std::future<Path> requestPath(glm::ivec3 start, glm::ivec3 goal){
+	PathRequest* request = new PathRequest{start, goal, {}};
+	std::future<Path> result = request->result.get_future();
+	requests.push(request);
+	return result;
+    }
+
+    void init(){
+	for(int i = 0; i < NAVIGATION_WORKERS; i++) workers.emplace_back(work);
+    }
+
+    void stop(){
+	// One stop request per worker. Aborting the queue could miss a worker that is still busy
+	// with a path and only calls pop() afterwards
+	PathRequest* request{nullptr};
+	while(requests.try_pop(request)) delete request;
+	for(size_t i = 0; i < workers.size(); i++) requests.push(nullptr);
+	for(auto& w : workers) w.join();
+	workers.clear();
+    }
+};
@@ -0,0 +1,200 @@
+#include "occlusionculler.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+namespace occlusionculler{
+    // Depth is stored as 1/w (the inverse of the view depth), which is linear in screen space and
+    // so can be interpolated directly while rasterizing. Bigger values are nearer, 0 is infinitely
+    // far away.
+    // Level 0 is the depth buffer, each next level holds the farthest value of a 2x2 block of the
+    // previous one
+    float hiz[OCCLUSION_LEVELS][OCCLUSION_WIDTH * OCCLUSION_HEIGHT];
+    glm::mat4 vp;
+    int occluders{0};
+
+    // Anything nearer than this is not rasterized, and boxes reaching it are always visible
+    constexpr float NEAR_W = 0.1f;
+
+    int levelWidth(int level){ return std::max(OCCLUSION_WIDTH >> level, 1); }
+    int levelHeight(int level){ return std::max(OCCLUSION_HEIGHT >> level, 1); }
+
+    void beginFrame(const glm::mat4& viewProjection){
+	vp = viewProjection;
+	occluders = 0;
+	std::fill(hiz[0], hiz[0] + OCCLUSION_WIDTH * OCCLUSION_HEIGHT, 0.0f);
+    }
+
+    // Screen position in pixels (x, y) and inverse depth (z). Returns false if the vertex is too
+    // near or behind the camera
+    bool project(glm::vec3 v, glm::vec3& out){
+	glm::vec4 c = vp * glm::vec4(v, 1.0f);
+	if(c.w < NEAR_W) return false;
+	float invw = 1.0f / c.w;
+	out = glm::vec3((c.x * invw * 0.5f + 0.5f) * OCCLUSION_WIDTH, (c.y * invw * 0.5f + 0.5f) *
+		OCCLUSION_HEIGHT, invw);
+	return true;
+    }
+
+    void rasterizeTriangle(glm::vec3 a, glm::vec3 b, glm::vec3 c){
+	float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+	if(std::abs(area) < 1e-6f) return;
+	// Either winding is fine, an occluder hides what's behind it from both sides
+	if(area < 0){
+	    std::swap(b, c);
+	    area = -area;
+	}
+
+	int minx = std::max(static_cast<int>(std::floor(std::min({a.x, b.x, c.x}))), 0);
+	int maxx = std::min(static_cast<int>(std::ceil(std::max({a.x, b.x, c.x}))), OCCLUSION_WIDTH - 1);
+	int miny = std::max(static_cast<int>(std::floor(std::min({a.y, b.y, c.y}))), 0);
+	int maxy = std::min(static_cast<int>(std::ceil(std::max({a.y, b.y, c.y}))), OCCLUSION_HEIGHT - 1);
+	if(minx > maxx || miny > maxy) return;
+
+	// Edge functions, evaluated at pixel centers. Each one is 0 on an edge and grows linearly
+	// towards the opposite vertex
+	const float inv_area = 1.0f / area;
+	const float e0x = (b.y - c.y), e0y = (c.x - b.x), e0c = b.x * c.y - b.y * c.x;
+	const float e1x = (c.y - a.y), e1y = (a.x - c.x), e1c = c.x * a.y - c.y * a.x;
+	const float e2x = (a.y - b.y), e2y = (b.x - a.x), e2c = a.x * b.y - a.y * b.x;
+
+	for(int y = miny; y <= maxy; y++){
+	    const float py = y + 0.5f;
+	    float* row = hiz[0] + y * OCCLUSION_WIDTH;
+	    int x = minx;
+
+#ifdef __SSE2__
+	    // 4 pixels of the row at a time
+	    const __m128 zero = _mm_setzero_ps();
+	    const __m128 steps = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+	    for(; x + 4 <= maxx + 1; x += 4){
+		__m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), steps);
+		__m128 w0 = _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(e0x)), _mm_set1_ps(e0y * py + e0c));
+		__m128 w1 = _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(e1x)), _mm_set1_ps(e1y * py + e1c));
+		__m128 w2 = _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(e2x)), _mm_set1_ps(e2y * py + e2c));
+		__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(w0, zero), _mm_cmpge_ps(w1, zero)),
+			_mm_cmpge_ps(w2, zero));
+		if(_mm_movemask_ps(inside) == 0) continue;
+
+		__m128 z = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(w0, _mm_set1_ps(a.z)),
+				_mm_mul_ps(w1, _mm_set1_ps(b.z))), _mm_mul_ps(w2, _mm_set1_ps(c.z))),
+			_mm_set1_ps(inv_area));
+		__m128 old = _mm_loadu_ps(row + x);
+		// Keep the nearest, only where the pixel is covered
+		__m128 nearest = _mm_max_ps(old, z);
+		_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old)));
+	    }
+#endif
+
+	    for(; x <= maxx; x++){
+		const float px = x + 0.5f;
+		float w0 = e0x * px + e0y * py + e0c;
+		float w1 = e1x * px + e1y * py + e1c;
+		float w2 = e2x * px + e2y * py + e2c;
+		if(w0 < 0 || w1 < 0 || w2 < 0) continue;
+
+		float z = (w0 * a.z + w1 * b.z + w2 * c.z) * inv_area;
+		row[x] = std::max(row[x], z);
+	    }
+	}
+    }
+
+    void addOccluder(glm::vec3 v0, glm::vec3 v1, glm::vec3 v2, glm::vec3 v3){
+	glm::vec3 p0, p1, p2, p3;
+	// Clipping against the near plane isn't worth it for occluders, just skip them
+	if(!project(v0, p0) || !project(v1, p1) || !project(v2, p2) || !project(v3, p3)) return;
+
+	rasterizeTriangle(p0, p1, p2);
+	rasterizeTriangle(p0, p2, p3);
+	occluders++;
+    }
+
+    void buildHiZ(){
+	for(int l = 1; l < OCCLUSION_LEVELS; l++){
+	    const int w = levelWidth(l), h = levelHeight(l);
+	    const int pw = levelWidth(l - 1), ph = levelHeight(l - 1);
+	    for(int y = 0; y < h; y++){
+		const int y0 = std::min(2 * y, ph - 1), y1 = std::min(2 * y + 1, ph - 1);
+		for(int x = 0; x < w; x++){
+		    const int x0 = std::min(2 * x, pw - 1), x1 = std::min(2 * x + 1, pw - 1);
+		    hiz[l][y * w + x] = std::min({hiz[l - 1][y0 * pw + x0], hiz[l - 1][y0 * pw + x1],
+			    hiz[l - 1][y1 * pw + x0], hiz[l - 1][y1 * pw + x1]});
+		}
+	    }
+	}
+    }
+
+    bool isOccluded(glm::vec3 min, glm::vec3 max){
+	// Project the 8 corners of the box, getting the screen rectangle and the nearest depth
+	float sx_min = OCCLUSION_WIDTH, sx_max = 0, sy_min = OCCLUSION_HEIGHT, sy_max = 0;
+	float nearest = 0;
+
+#ifdef __SSE2__
+	// Corners 0-3 and 4-7 differ only in z, so transform 4 at a time
+	const __m128 xs = _mm_set_ps(max.x, min.x, max.x, min.x);
+	const __m128 ys = _mm_set_ps(max.y, max.y, min.y, min.y);
+	float cx[8], cy[8], cw[8];
+	for(int half = 0; half < 2; half++){
+	    const float z = half ? max.z : min.z;
+	    __m128 out[3];
+	    const int rows[3] = {0, 1, 3};
+	    for(int r = 0; r < 3; r++){
+		const int row = rows[r];
+		out[r] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(xs, _mm_set1_ps(vp[0][row])), _mm_mul_ps(ys,
+				_mm_set1_ps(vp[1][row]))), _mm_set1_ps(vp[2][row] * z + vp[3][row]));
+	    }
+	    _mm_storeu_ps(cx + 4 * half, out[0]);
+	    _mm_storeu_ps(cy + 4 * half, out[1]);
+	    _mm_storeu_ps(cw + 4 * half, out[2]);
+	}
+#endif
+
+	for(int i = 0; i < 8; i++){
+#ifdef __SSE2__
+	    glm::vec4 c(cx[i], cy[i], 0, cw[i]);
+#else
+	    glm::vec4 c = vp * glm::vec4(i & 1 ? max.x : min.x, i & 2 ? max.y : min.y, i & 4 ? max.z :
+		    min.z, 1.0f);
+#endif
+	    // Crossing the near plane, the camera is likely inside or right next to the box
+	    if(c.w < NEAR_W) return false;
+
+	    const float invw = 1.0f / c.w;
+	    const float sx = (c.x * invw * 0.5f + 0.5f) * OCCLUSION_WIDTH;
+	    const float sy = (c.y * invw * 0.5f + 0.5f) * OCCLUSION_HEIGHT;
+	    sx_min = std::min(sx_min, sx);
+	    sx_max = std::max(sx_max, sx);
+	    sy_min = std::min(sy_min, sy);
+	    sy_max = std::max(sy_max, sy);
+	    nearest = std::max(nearest, invw);
+	}
+
+	// Grown by a pixel, the depth buffer only knows about pixel centers
+	int x0 = std::max(static_cast<int>(sx_min) - 1, 0);
+	int x1 = std::min(static_cast<int>(sx_max) + 1, OCCLUSION_WIDTH - 1);
+	int y0 = std::max(static_cast<int>(sy_min) - 1, 0);
+	int y1 = std::min(static_cast<int>(sy_max) + 1, OCCLUSION_HEIGHT - 1);
+	if(x0 > x1 || y0 > y1) return false;
+
+	// Pick the level where the rectangle covers at most 2x2 texels
+	int level = 0;
+	while(level < OCCLUSION_LEVELS - 1 && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >>
+			level) > 1)) level++;
+	x0 >>= level; x1 >>= level;
+	y0 >>= level; y1 >>= level;
+
+	const int w = levelWidth(level);
+	for(int y = y0; y <= y1; y++)
+	    for(int x = x0; x <= x1; x++)
+		if(nearest >= hiz[level][y * w + x]) return false;
+	return true;
+    }
+
+    int getOccluderCount(){
+	return occluders;
+    }
+};
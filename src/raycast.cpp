@@ -0,0 +1,149 @@
+#include "raycast.hpp"
+
+#include <chrono>
+#include <limits>
+#include <random>
+
+#include <oneapi/tbb/parallel_for.h>
+
+#include "chunk.hpp"
+#include "chunkmanager.hpp"
+#include "debugwindow.hpp"
+
+namespace raycast{
+    // Division rounding towards negative infinity, blocks at negative coordinates are still
+    // outside the world but the traversal has to step through them correctly
+    int chunkOf(int v){ return v >= 0 ? v / CHUNK_SIZE : (v - CHUNK_SIZE + 1) / CHUNK_SIZE; }
+
+    RayHit cast(glm::vec3 origin, glm::vec3 direction, float max_distance){
+	RayHit hit;
+	if(glm::dot(direction, direction) == 0.0f) return hit;
+
+	// Doubles keep the traversal exact far from the origin of the world
+	const glm::dvec3 o(origin);
+	const glm::dvec3 d = glm::normalize(glm::dvec3(direction));
+	const double inf = std::numeric_limits<double>::infinity();
+
+	glm::ivec3 step, voxel(glm::floor(o));
+	glm::dvec3 delta, tmax;
+	// Value of t at which the ray crosses the next boundary along axis a, from where it is now
+	auto boundary = [&](int a){
+	    if(d[a] > 0) return (voxel[a] + 1 - o[a]) / d[a];
+	    if(d[a] < 0) return (voxel[a] - o[a]) / d[a];
+	    return inf;
+	};
+	for(int a = 0; a < 3; a++){
+	    step[a] = d[a] > 0 ? 1 : d[a] < 0 ? -1 : 0;
+	    delta[a] = d[a] != 0 ? std::abs(1.0 / d[a]) : inf;
+	    tmax[a] = boundary(a);
+	}
+
+	auto& chunks = chunkmanager::getChunks();
+	// The chunk the ray is in is kept between steps, a lookup only happens when changing chunk
+	chunkmanager::ChunkTable::const_accessor a;
+	Chunk::Chunk* chunk{nullptr};
+	glm::ivec3 chunk_pos(-1);
+	bool looked_up{false};
+
+	double t{0};
+	int axis{-1};
+	while(t <= max_distance){
+	    const glm::ivec3 c(chunkOf(voxel.x), chunkOf(voxel.y), chunkOf(voxel.z));
+	    if(!looked_up || c != chunk_pos){
+		a.release();
+		chunk = nullptr;
+		chunk_pos = c;
+		looked_up = true;
+		if(c.x >= 0 && c.y >= 0 && c.z >= 0 && c.x < 1024 && c.y < 1024 && c.z < 1024 &&
+			chunks.find(a, Chunk::calculateIndex(c.x, c.y, c.z)) &&
+			a->second->getState(Chunk::CHUNK_STATE_GENERATED))
+		    chunk = a->second;
+	    }
+
+	    // Nothing to hit in here, jump to where the ray leaves the chunk
+	    if(chunk == nullptr || chunk->getState(Chunk::CHUNK_STATE_EMPTY)){
+		const glm::ivec3 cmin = c * CHUNK_SIZE;
+		const glm::ivec3 cmax = cmin + CHUNK_SIZE;
+		double exit{inf};
+		for(int i = 0; i < 3; i++){
+		    double te = d[i] > 0 ? (cmax[i] - o[i]) / d[i] : d[i] < 0 ? (cmin[i] - o[i]) / d[i] :
+			inf;
+		    if(te < exit){
+			exit = te;
+			axis = i;
+		    }
+		}
+		if(exit > max_distance) break;
+
+		const glm::dvec3 p = o + d * exit;
+		for(int i = 0; i < 3; i++)
+		    voxel[i] = glm::clamp(static_cast<int>(std::floor(p[i])), cmin[i], cmax[i] - 1);
+		voxel[axis] = step[axis] > 0 ? cmax[axis] : cmin[axis] - 1;
+		for(int i = 0; i < 3; i++) tmax[i] = boundary(i);
+		t = exit;
+		continue;
+	    }
+
+	    const Block b = chunk->getBlock(voxel.x - c.x * CHUNK_SIZE, voxel.y - c.y * CHUNK_SIZE,
+		    voxel.z - c.z * CHUNK_SIZE);
+	    if(b != Block::AIR && b != Block::NULLBLK){
+		hit.hit = true;
+		hit.block = voxel;
+		if(axis >= 0) hit.normal[axis] = -step[axis];
+		hit.distance = t;
+		hit.type = b;
+		return hit;
+	    }
+
+	    // Next voxel
+	    axis = tmax.x < tmax.y ? (tmax.x < tmax.z ? 0 : 2) : (tmax.y < tmax.z ? 1 : 2);
+	    t = tmax[axis];
+	    voxel[axis] += step[axis];
+	    tmax[axis] += delta[axis];
+	}
+
+	return hit;
+    }
+
+    RayHit cast(const Ray& ray){
+	return cast(ray.origin, ray.direction, ray.max_distance);
+    }
+
+    void castBatch(const std::vector<Ray>& rays, std::vector<RayHit>& hits){
+	hits.resize(rays.size());
+	oneapi::tbb::parallel_for(oneapi::tbb::blocked_range<size_t>(0, rays.size()),
+		[&](const oneapi::tbb::blocked_range<size_t>& r){
+		    for(size_t i = r.begin(); i != r.end(); i++) hits[i] = cast(rays[i]);
+		});
+    }
+
+    bool lineOfSight(glm::vec3 from, glm::vec3 to){
+	const float distance = glm::distance(from, to);
+	if(distance == 0.0f) return true;
+	return !cast(from, to - from, distance).hit;
+    }
+
+    double benchmark(glm::vec3 origin, int count, float max_distance){
+	std::mt19937 rng(1234);
+	std::normal_distribution<float> n(0.0f, 1.0f);
+
+	std::vector<Ray> rays(count);
+	for(auto& r : rays){
+	    r.origin = origin;
+	    r.direction = glm::vec3(n(rng), n(rng), n(rng));
+	    r.max_distance = max_distance;
+	}
+
+	std::vector<RayHit> hits;
+	const auto start = std::chrono::steady_clock::now();
+	castBatch(rays, hits);
+	const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+		start).count();
+
+	int n_hits{0};
+	for(const auto& h : hits) n_hits += h.hit;
+	debug::window::set_parameter("raycast_benchmark_hits", n_hits);
+	debug::window::set_parameter("raycast_benchmark_time", (float)(elapsed * 1000.0));
+	return elapsed > 0 ? count / elapsed : 0;
+    }
+};
@@ -1,13 +1,25 @@
 #include "renderer.hpp"
 
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
 #include <glm/ext.hpp>
 #include <glm/gtx/string_cast.hpp>
 #include <oneapi/tbb/concurrent_hash_map.h>
 
 #include "chunkmanager.hpp"
 #include "chunkmesher.hpp"
+#include "culling.hpp"
 #include "debugwindow.hpp"
+#include "farterrain.hpp"
+#include "freelistallocator.hpp"
 #include "globals.hpp"
+#include "occlusionculler.hpp"
 #include "stb_image.h"
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
@@ -19,10 +31,100 @@ namespace renderer{
     ChunkMeshDataQueue MeshDataQueue;
     IndexQueue MeshDataToDelete;
 
-    Shader* theShader, *quadShader;
+    // theShader draws the quads by vertex pulling, gsShader is the fallback path expanding points
+    // into quads in a geometry shader
+    Shader* theShader, *gsShader, *quadShader;
     GLuint chunkTexture;
+    // Vertex pulling has no vertex attributes, but core profile still needs a VAO to be bound
+    GLuint emptyVAO;
+
+    /* Quad arena */
+    // All the chunk meshes are sub-allocated from a single buffer, so that all the visible chunks
+    // can be drawn with a single glMultiDrawArrays call. Sizes and offsets are in quads.
+    // arenaVAO is used by the geometry shader path, arenaTBO by the vertex pulling path
+    GLuint arenaVBO, arenaVAO, arenaTBO;
+    FreeListAllocator arenaAllocator;
+    // Meshes get a bit of room to grow, to avoid reallocating for every edit
+    constexpr uint32_t ARENA_ALLOCATION_GRANULARITY = 64;
+    constexpr uint32_t ARENA_INITIAL_CAPACITY = 1 << 20;
+
+    // The position of each chunk, indexed by the slot the quads of the chunk refer to
+    constexpr int CHUNK_SLOTS = 1 << 16;
+    GLuint chunkPositionsVBO, chunkPositionsTBO;
+    std::vector<uint16_t> free_slots;
+
+    /* Upload scheduling */
+    // Incoming meshes and deletions are not processed all at once, they wait here and are handled
+    // by priority until the time budget of the frame runs out
+    std::unordered_map<chunk_index_t, ChunkMeshData*> pending_uploads;
+    std::unordered_set<chunk_index_t> pending_deletes;
+    // ((out of view, distance), mesh), sorted to decide the upload order
+    std::vector<std::pair<std::pair<bool, float>, ChunkMeshData*>> upload_order;
+    float upload_budget_ms{2.0f};
+    int budget_overruns{0};
+
+    /* Streaming upload ring */
+    // Meshes are written into a ring buffer and then copied GPU-side into their arena range. The
+    // ring is split into a segment per frame in flight, each protected by a fence
+    constexpr int RING_SEGMENTS = 3;
+    constexpr uint32_t RING_SEGMENT_SIZE = 2 << 20;
+    GLuint uploadRingVBO;
+    GLsync ring_fences[RING_SEGMENTS]{};
+    int ring_segment{0};
+    uint32_t ring_used{0};
+    char* ring_mapped{nullptr};
+    int ring_stalls{0};
+    typedef struct RingCopy{
+	GLintptr ring_offset, arena_offset;
+	GLsizeiptr size;
+    } RingCopy;
+    std::vector<RingCopy> ring_copies;
+
+    /* Draw list building */
+    // Culling, sorting and building the draw ranges for glMultiDrawArrays happen on a separate
+    // thread. The list for the next frame is built while the current one is submitted, then the
+    // two are swapped
+    typedef struct DrawList{
+	std::vector<GLint> firsts;
+	std::vector<GLsizei> counts;
+	int chunks{0}, vertices{0}, tested{0}, occluded{0}, occluders{0}, unreachable{0}, backfacing{0};
+	double cull_time{0}, occlusion_time{0}, search_time{0};
+	// Whether the ranges are in points (geometry shader) or in triangle vertices
+	bool geometry_shader{false};
+    } DrawList;
+    DrawList draw_lists[2];
+    int front_list{0};
+
+    std::thread cull_thread;
+    // Held by the culling thread while building, and by the render thread while changing anything
+    // the culling thread reads (the culling arrays, arena offsets and mesh sizes)
+    std::mutex cull_mutex;
+    std::condition_variable cull_cv;
+    bool cull_requested{false}, cull_done{true}, cull_stop{false};
+    // Frame the back list is being built for
+    glm::vec4 cull_planes[6];
+    glm::vec3 cull_camera;
+    glm::mat4 cull_view_projection;
+    bool cull_geometry_shader{false}, cull_occlusion{true}, cull_connectivity{true};
+    bool occlusion_culling{true}, connectivity_culling{true};
+    // Number of the current visibility search through the chunk connectivity graph
+    uint64_t search{0};
+    // Only the occluders of the nearest visible chunks are rasterized
+    constexpr int OCCLUDER_CHUNKS = 64;
+    std::vector<RenderInfo*> visible_chunks;
+
+    // A draw list can still reference arena ranges and slots that have been freed after it was
+    // built, so they are only given back after the lists built before the free are gone
+    typedef struct DeferredFree{
+	int64_t arena_offset;
+	uint32_t arena_capacity;
+	int slot;
+	uint64_t frame;
+    } DeferredFree;
+    std::vector<DeferredFree> deferred_frees;
+    constexpr uint64_t FREE_DELAY_FRAMES = 2;
+    uint64_t frame{0};
 
-    Shader* getRenderShader() { return theShader; }
     ChunkMeshDataQueue& getMeshDataQueue(){ return MeshDataQueue; }
     IndexQueue& getDeleteIndexQueue(){ return MeshDataToDelete; }
 
@@ -31,6 +133,9 @@ namespace renderer{
 
     int crosshair_type{0};
     bool wireframe{false};
+    bool geometry_shader{false};
+
+    Shader* getRenderShader() { return geometry_shader ? gsShader : theShader; }
 
     void init(GLFWwindow* window){
 	// Setup rendering
@@ -84,7 +189,8 @@ namespace renderer{
 
 	// Rendering of the world
 	// Create Shader
-	theShader = new Shader{"shaders/shader-texture.gs", "shaders/shader-texture.vs", "shaders/shader-texture.fs"};
+	theShader = new Shader{nullptr, "shaders/shader-texture-vp.vs", "shaders/shader-texture.fs"};
+	gsShader = new Shader{"shaders/shader-texture.gs", "shaders/shader-texture.vs", "shaders/shader-texture.fs"};
 	quadShader = new Shader{nullptr, "shaders/shader-quad.vs", "shaders/shader-quad.fs"};
 
 	// Block textures
@@ -111,8 +217,53 @@ namespace renderer{
 	glTexParameteri(GL_TEXTURE_2D_ARRAY,GL_TEXTURE_WRAP_S,GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D_ARRAY,GL_TEXTURE_WRAP_T,GL_REPEAT);
 
+	// Quad arena and chunk positions
+	glGenVertexArrays(1, &emptyVAO);
+	glGenVertexArrays(1, &arenaVAO);
+	glGenBuffers(1, &arenaVBO);
+	glGenTextures(1, &arenaTBO);
+	// Each quad is a texel of the buffer texture, which might be smaller than the initial capacity
+	GLint max_texels;
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texels);
+	const uint32_t arena_capacity = std::min<uint32_t>(ARENA_INITIAL_CAPACITY, max_texels);
+	glBindBuffer(GL_ARRAY_BUFFER, arenaVBO);
+	glBufferData(GL_ARRAY_BUFFER, arena_capacity * sizeof(ChunkMeshQuad), NULL, GL_DYNAMIC_DRAW);
+	arenaAllocator.grow(arena_capacity);
+	attach_arena();
+
+	glGenBuffers(1, &uploadRingVBO);
+	glBindBuffer(GL_COPY_READ_BUFFER, uploadRingVBO);
+	glBufferData(GL_COPY_READ_BUFFER, RING_SEGMENTS * RING_SEGMENT_SIZE, NULL, GL_STREAM_COPY);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+	glGenBuffers(1, &chunkPositionsVBO);
+	glGenTextures(1, &chunkPositionsTBO);
+	glBindBuffer(GL_TEXTURE_BUFFER, chunkPositionsVBO);
+	glBufferData(GL_TEXTURE_BUFFER, CHUNK_SLOTS * sizeof(glm::vec4), NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_BUFFER, chunkPositionsTBO);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, chunkPositionsVBO);
+	glActiveTexture(GL_TEXTURE0);
+	for(int i = CHUNK_SLOTS - 1; i >= 0; i--) free_slots.push_back(i);
+
+	// The block textures stay on texture unit 0, quads are pulled from texture unit 1 and chunk
+	// positions from texture unit 2
+	theShader->use();
+	theShader->setInt("quads", 1);
+	theShader->setInt("chunkPositions", 2);
+	gsShader->use();
+	gsShader->setInt("chunkPositions", 2);
+
 	debug::window::set_parameter("crosshair_type_return", &crosshair_type);
 	debug::window::set_parameter("wireframe_return", &wireframe);
+	debug::window::set_parameter("geometry_shader_return", &geometry_shader);
+	debug::window::set_parameter("upload_budget_return", &upload_budget_ms);
+	debug::window::set_parameter("occlusion_culling_return", &occlusion_culling);
+	debug::window::set_parameter("connectivity_culling_return", &connectivity_culling);
+
+	cull_thread = std::thread(build_draw_lists);
+	farterrain::init();
     }
 
 
@@ -132,111 +283,61 @@ namespace renderer{
 	debug::window::prerender();
 
 	/* RENDER THE WORLD TO TEXTURE */
-	int total{0}, toGpu{0}, oof{0}, vertices{0};
+	int total{0}, toGpu{0}, vertices{0};
 	glm::vec4 frustumPlanes[6];
 	theCamera.getFrustumPlanes(frustumPlanes, true);
 	glm::vec3 cameraPos = theCamera.getPos();	
 	glm::vec3 cameraChunkPos = cameraPos / static_cast<float>(CHUNK_SIZE);
 
-	theShader->use();
-	theShader->setVec3("viewPos", cameraPos);
-
-	/* Process incoming mesh data */
-	ChunkMeshData* m;
-	while(MeshDataQueue.try_pop(m)){
-	    RenderTable::accessor a;
-	    RenderInfo* render_info;
-
-	    if(ChunksToRender.find(a, m->index)){
-		render_info = a->second;
-		render_info->position = m->position;
-		render_info->num_vertices = m->num_vertices;
-
-		// Always updated the mesh, even if it's empty
-		// This should solve the problem of having floating quads when destroying a block
-		// near chunk borders
-		send_chunk_to_gpu(m, render_info);
-	    }else{
-		render_info = new RenderInfo();
-		render_info->index = m->index;
-		render_info->position = m->position;
-		render_info->num_vertices = m->num_vertices;
-
-		ChunksToRender.emplace(a, std::make_pair(render_info->index, render_info));
-
-		// Only send the mesh to the GPU if it's not empty
-		if(render_info->num_vertices > 0) send_chunk_to_gpu(m, render_info);
-	    }
-
-	    chunkmesher::getMeshDataQueue().push(m);
-	}
-
-	/* Process chunks to be removed */
-	chunk_index_t queue_index;
-	while(MeshDataToDelete.try_pop(queue_index)){
-	    RenderTable::accessor a;
-
-	    if(ChunksToRender.find(a, queue_index)){
-		RenderInfo* render_info = a->second;
-		render_info->deallocateBuffers();
-		delete render_info;
-		ChunksToRender.erase(a);
-	    }
-	}
-
 	/* Render the chunks */
-	// parallel_for cannot be used since all the rendering needs to happen in a single thread
-	for(RenderTable::iterator i = ChunksToRender.begin(); i != ChunksToRender.end(); i++){
-	    RenderInfo* render_info = i->second;
-
-	    if(render_info->num_vertices > 0)
-	    {
-		total++;
-
-		// Increase total vertex count
-		vertices += render_info->num_vertices;
-
-		// Perform frustum culling and eventually render
-		glm::vec3 chunk = render_info->position;
-		glm::vec4 chunkW = glm::vec4(chunk.x*static_cast<float>(CHUNK_SIZE), chunk.y*static_cast<float>(CHUNK_SIZE), chunk.z*static_cast<float>(CHUNK_SIZE),1.0);
-		glm::mat4 model = glm::translate(glm::mat4(1.0), ((float)CHUNK_SIZE) * chunk);
-
-		// Check if all the corners of the chunk are outside any of the planes
-		// TODO (?) implement frustum culling as per (Inigo Quilez)[https://iquilezles.org/articles/frustumcorrect/], and check each
-		// plane against each corner of the chunk
-		bool out=false;
-		int a{0};
-		for(int p = 0; p < 6; p++){
-		    a = 0;
-		    for(int i = 0; i < 8; i++)  a += glm::dot(frustumPlanes[p], glm::vec4(chunkW.x + ((float)(i & 1))*CHUNK_SIZE, chunkW.y
-				    + ((float)((i & 2) >> 1))*CHUNK_SIZE, chunkW.z + ((float)((i & 4) >> 2))*CHUNK_SIZE, 1.0)) < 0.0;
-
-		    if(a==8){
-			out=true;
-			break;
-		    }
-		}
-
-		if (!out)
-		{
-		    theShader->setMat4("model", model);
-		    theShader->setMat4("view", theCamera.getView());
-		    theShader->setMat4("projection", theCamera.getProjection());
-
-		    glBindVertexArray(render_info->VAO);
-		    glDrawArrays(GL_POINTS, 0, render_info->num_vertices);
-		    glBindVertexArray(0);
-
-		    toGpu++;
-		}
-	    }
+	// Take the draw list built during the last frame, and start building the next one with the
+	// camera of this frame. Uploads are done in between, when the culling thread is idle
+	DrawList& draw_list = swap_draw_lists();
+	schedule_uploads(frustumPlanes, cameraChunkPos);
+	request_draw_list(frustumPlanes, cameraPos, theCamera.getProjection() * theCamera.getView());
+
+	// Draw with the path the list was built for, it lags a frame behind when switching
+	Shader* shader = draw_list.geometry_shader ? gsShader : theShader;
+	shader->use();
+	shader->setVec3("viewPos", cameraPos);
+
+	toGpu = draw_list.chunks;
+	total = culling::size();
+	vertices = draw_list.vertices;
+
+	// View and projection are the same for all the chunks, set them only once
+	shader->setMat4("view", theCamera.getView());
+	shader->setMat4("projection", theCamera.getProjection());
+	if(!draw_list.firsts.empty()){
+	    glBindVertexArray(draw_list.geometry_shader ? arenaVAO : emptyVAO);
+	    glMultiDrawArrays(draw_list.geometry_shader ? GL_POINTS : GL_TRIANGLES, draw_list.firsts.data(),
+		    draw_list.counts.data(), draw_list.firsts.size());
+	    glBindVertexArray(0);
 	}
 
+	/* Heightfield beyond the voxels */
+	farterrain::update(cameraPos);
+	farterrain::render(theCamera.getView(), theCamera.getProjection(), cameraPos);
+
 	debug::window::set_parameter("render_chunks_total", (int)(ChunksToRender.size()));
 	debug::window::set_parameter("render_chunks_rendered", toGpu);
 	debug::window::set_parameter("render_chunks_renderable", total);
 	debug::window::set_parameter("render_chunks_culled", total-toGpu);
 	debug::window::set_parameter("render_chunks_vertices", vertices);
+	debug::window::set_parameter("render_cull_time", (float)(draw_list.cull_time * 1000.0));
+	debug::window::set_parameter("render_cull_tested", draw_list.tested);
+	debug::window::set_parameter("render_connectivity_culled", draw_list.unreachable);
+	debug::window::set_parameter("render_connectivity_time", (float)(draw_list.search_time * 1000.0));
+	debug::window::set_parameter("render_occlusion_culled", draw_list.occluded);
+	debug::window::set_parameter("render_occlusion_occluders", draw_list.occluders);
+	debug::window::set_parameter("render_occlusion_time", (float)(draw_list.occlusion_time * 1000.0));
+	debug::window::set_parameter("mesh_pool_available", (int)chunkmesher::getMeshDataQueue().size());
+	debug::window::set_parameter("render_arena_capacity", (int)arenaAllocator.getCapacity());
+	debug::window::set_parameter("render_arena_used", (int)arenaAllocator.getUsed());
+	debug::window::set_parameter("render_arena_free_ranges", (int)arenaAllocator.getFreeRanges());
+	debug::window::set_parameter("render_draw_calls", draw_list.firsts.empty() ? 0 : 1);
+	debug::window::set_parameter("render_draw_ranges", (int)draw_list.firsts.size());
+	debug::window::set_parameter("render_backfacing_quads", draw_list.backfacing);
 
 	/* DISPLAY TEXTURE ON A QUAD THAT FILLS THE SCREEN */
 	// Now to render the quad, with the texture on top
@@ -259,34 +360,549 @@ namespace renderer{
 	debug::window::render();
     }
 
+    DrawList& swap_draw_lists(){
+	std::unique_lock<std::mutex> lock(cull_mutex);
+	// Normally the list is long done by now
+	cull_cv.wait(lock, []{ return cull_done; });
+	front_list = 1 - front_list;
+	return draw_lists[front_list];
+    }
+
+    void request_draw_list(glm::vec4 frustumPlanes[6], glm::vec3 cameraPos, glm::mat4 viewProjection){
+	{
+	    std::lock_guard<std::mutex> lock(cull_mutex);
+	    for(int i = 0; i < 6; i++) cull_planes[i] = frustumPlanes[i];
+	    cull_camera = cameraPos;
+	    cull_view_projection = viewProjection;
+	    cull_geometry_shader = geometry_shader;
+	    cull_occlusion = occlusion_culling;
+	    cull_connectivity = connectivity_culling;
+	    cull_requested = true;
+	    cull_done = false;
+	}
+	cull_cv.notify_all();
+    }
+
+    void build_draw_lists(){
+	std::unique_lock<std::mutex> lock(cull_mutex);
+	while(true){
+	    cull_cv.wait(lock, []{ return cull_requested || cull_stop; });
+	    if(cull_stop) break;
+	    cull_requested = false;
+
+	    DrawList& list = draw_lists[1 - front_list];
+	    list.firsts.clear();
+	    list.counts.clear();
+	    list.vertices = 0;
+	    visible_chunks.clear();
+
+	    // Only the chunks with something to draw are in the culling arrays
+	    const double start = glfwGetTime();
+	    list.tested = culling::cull(cull_planes, visible_chunks);
+
+	    // Drop the chunks that can't be seen through the caves and open air from the camera
+	    list.unreachable = 0;
+	    list.search_time = 0;
+	    if(cull_connectivity && connectivity_search(list)){
+		auto reachable_end = std::remove_if(visible_chunks.begin(), visible_chunks.end(),
+			[](const RenderInfo* r){ return r->reached_search != search; });
+		list.unreachable = visible_chunks.end() - reachable_end;
+		visible_chunks.erase(reachable_end, visible_chunks.end());
+	    }
+
+	    // Front to back, so that early depth testing discards as much as possible
+	    for(RenderInfo* render_info : visible_chunks)
+		render_info->camera_distance = glm::distance(cull_camera, (render_info->aabb_min +
+			    render_info->aabb_max) * 0.5f);
+	    std::sort(visible_chunks.begin(), visible_chunks.end(), [](const RenderInfo* u,
+			const RenderInfo* v){ return u->camera_distance < v->camera_distance; });
+
+	    list.occluded = list.occluders = 0;
+	    list.occlusion_time = 0;
+	    if(cull_occlusion) occlusion_cull(visible_chunks, list);
+
+	    // The geometry shader path draws a point per quad, vertex pulling two triangles per quad
+	    list.geometry_shader = cull_geometry_shader;
+	    const int vertices_per_quad = cull_geometry_shader ? 1 : 6;
+	    list.backfacing = 0;
+	    list.chunks = visible_chunks.size();
+	    for(RenderInfo* render_info : visible_chunks){
+		// All the faces of a direction are behind the camera when the whole chunk is on the
+		// side they face away from, e.g. +X faces when the camera is at the -X of the chunk
+		bool facing[6];
+		for(int dim = 0; dim < 3; dim++){
+		    facing[dim] = cull_camera[dim] < render_info->aabb_max[dim];
+		    facing[dim + 3] = cull_camera[dim] > render_info->aabb_min[dim];
+		}
+
+		// One range for each run of consecutive directions facing the camera
+		const auto& offsets = render_info->direction_offsets;
+		for(int d = 0; d < 6; d++){
+		    if(!facing[d]){
+			list.backfacing += offsets[d + 1] - offsets[d];
+			continue;
+		    }
+
+		    int end = d;
+		    while(end < 5 && facing[end + 1]) end++;
+		    if(offsets[end + 1] > offsets[d]){
+			list.firsts.push_back(vertices_per_quad * (render_info->arena_offset + offsets[d]));
+			list.counts.push_back(vertices_per_quad * (offsets[end + 1] - offsets[d]));
+			list.vertices += offsets[end + 1] - offsets[d];
+		    }
+		    d = end;
+		}
+	    }
+	    list.cull_time = glfwGetTime() - start;
+
+	    cull_done = true;
+	    cull_cv.notify_all();
+	}
+    }
+
+    // Breadth first search from the camera chunk through the connectivity graph of the chunks.
+    // Going into a chunk from a face, the search can only come out from the faces connected to
+    // it, and never in a direction opposite to one it already took, so that it doesn't turn back
+    // around corners towards the camera. Chunks out of the frustum are not crossed.
+    // Reached chunks are marked with the number of the search. Returns false if the search could
+    // not run, then everything is considered reachable
+    bool connectivity_search(DrawList& list){
+	typedef struct SearchNode{
+	    RenderInfo* render_info;
+	    // Face the chunk was entered from, -1 for the camera chunk
+	    int8_t entry;
+	    // Directions taken to get here
+	    uint8_t directions;
+	} SearchNode;
+	static std::vector<SearchNode> queue;
+
+	const double start = glfwGetTime();
+	search++;
+
+	auto find = [](glm::vec3 position) -> RenderInfo* {
+	    if(glm::any(glm::lessThan(position, glm::vec3(0))) ||
+		    glm::any(glm::greaterThan(position, glm::vec3(1023)))) return nullptr;
+	    RenderTable::const_accessor a;
+	    return ChunksToRender.find(a, Chunk::calculateIndex(position)) ? a->second : nullptr;
+	};
+
+	RenderInfo* camera_chunk = find(glm::floor(cull_camera / static_cast<float>(CHUNK_SIZE)));
+	if(camera_chunk == nullptr) return false;
+
+	queue.clear();
+	queue.push_back({camera_chunk, -1, 0});
+	camera_chunk->reached_search = search;
+	for(size_t i = 0; i < queue.size(); i++){
+	    const SearchNode node = queue[i];
+
+	    for(int face = 0; face < 6; face++){
+		const int opposite = face ^ 1;
+		if(node.directions & (1 << opposite)) continue;
+		if(node.entry >= 0 && !Chunk::facesConnected(node.render_info->connectivity, node.entry,
+			    face)) continue;
+
+		glm::vec3 position = node.render_info->position;
+		position[face / 2] += (face & 1) ? 1 : -1;
+		if(!chunk_in_frustum(position, cull_planes)) continue;
+
+		RenderInfo* next = find(position);
+		if(next == nullptr || next->reached_search == search) continue;
+
+		next->reached_search = search;
+		queue.push_back({next, static_cast<int8_t>(opposite), static_cast<uint8_t>(node.directions | (1
+				<< face))});
+	    }
+	}
+
+	list.search_time = glfwGetTime() - start;
+	return true;
+    }
+
+    void occlusion_cull(std::vector<RenderInfo*>& chunks, DrawList& list){
+	const double start = glfwGetTime();
+
+	// Chunks are sorted front to back, the nearest ones are the best occluders
+	occlusionculler::beginFrame(cull_view_projection);
+	const int occluder_chunks = std::min(static_cast<int>(chunks.size()), OCCLUDER_CHUNKS);
+	for(int i = 0; i < occluder_chunks; i++){
+	    glm::vec3 origin = chunks[i]->position * static_cast<float>(CHUNK_SIZE);
+	    for(const ChunkMeshQuad& q : chunks[i]->occluders){
+		glm::vec3 corner = origin + glm::vec3(q.corner());
+		glm::vec3 u(0), v(0);
+		u[(q.dim() + 1) % 3] = q.extents()[(q.dim() + 1) % 3];
+		v[(q.dim() + 2) % 3] = q.extents()[(q.dim() + 2) % 3];
+		occlusionculler::addOccluder(corner, corner + u, corner + u + v, corner + v);
+	    }
+	}
+	occlusionculler::buildHiZ();
+
+	// Remove the hidden chunks, keeping the order
+	auto visible_end = std::remove_if(chunks.begin(), chunks.end(), [](const RenderInfo* r){
+		return occlusionculler::isOccluded(r->aabb_min, r->aabb_max); });
+	list.occluded = chunks.end() - visible_end;
+	chunks.erase(visible_end, chunks.end());
+
+	list.occluders = occlusionculler::getOccluderCount();
+	list.occlusion_time = glfwGetTime() - start;
+    }
+
+    bool chunk_in_frustum(glm::vec3 chunk, glm::vec4 frustumPlanes[6]){
+	glm::vec3 min = chunk * static_cast<float>(CHUNK_SIZE);
+	return culling::testBox(min, min + static_cast<float>(CHUNK_SIZE), frustumPlanes) !=
+	    culling::Visibility::OUTSIDE;
+    }
+
+    void schedule_uploads(glm::vec4 frustumPlanes[6], glm::vec3 cameraChunkPos){
+	std::lock_guard<std::mutex> lock(cull_mutex);
+	process_deferred_frees();
+
+	const double start = glfwGetTime();
+	const double budget = upload_budget_ms / 1000.0;
+
+	// Collect everything that came in since the last frame. Popping is cheap, the expensive
+	// part is the upload
+	ChunkMeshData* m;
+	while(MeshDataQueue.try_pop(m)){
+	    // A chunk that was waiting to be removed came back in range
+	    if(pending_deletes.erase(m->index)) delete_chunk(m->index);
+
+	    // A newer mesh of the same chunk supersedes the old one
+	    auto pending = pending_uploads.find(m->index);
+	    if(pending != pending_uploads.end()){
+		chunkmesher::getMeshDataQueue().push(pending->second);
+		pending->second = m;
+	    }else pending_uploads[m->index] = m;
+	}
+
+	chunk_index_t queue_index;
+	while(MeshDataToDelete.try_pop(queue_index)){
+	    // No point in uploading a mesh that is going to be deleted
+	    auto pending = pending_uploads.find(queue_index);
+	    if(pending != pending_uploads.end()){
+		chunkmesher::getMeshDataQueue().push(pending->second);
+		pending_uploads.erase(pending);
+	    }
+	    pending_deletes.insert(queue_index);
+	}
+
+	// Deletions first, they are cheap and give space back to the arena
+	int uploaded{0}, deleted{0};
+	for(auto i = pending_deletes.begin(); i != pending_deletes.end() && glfwGetTime() - start <
+		budget; deleted++){
+	    delete_chunk(*i);
+	    i = pending_deletes.erase(i);
+	}
+
+	// Then uploads, chunks in view first and nearest first
+	upload_order.clear();
+	for(const auto& [index, mesh] : pending_uploads){
+	    bool visible = chunk_in_frustum(mesh->position, frustumPlanes);
+	    float distance = glm::distance(mesh->position + glm::vec3(0.5f), cameraChunkPos);
+	    upload_order.push_back(std::make_pair(std::make_pair(!visible, distance), mesh));
+	}
+	std::sort(upload_order.begin(), upload_order.end(), [](const auto& u, const auto& v){
+		return u.first < v.first; });
+
+	// Always upload at least a mesh per frame, so that a tiny budget still makes progress
+	ring_begin_frame();
+	for(const auto& entry : upload_order){
+	    if(uploaded > 0 && glfwGetTime() - start >= budget) break;
+
+	    ChunkMeshData* mesh = entry.second;
+	    // The upload ring is full for this frame, the rest waits
+	    if(!ring_fits(mesh->quads.size() * sizeof(ChunkMeshQuad))) break;
+	    upload_mesh(mesh);
+	    pending_uploads.erase(mesh->index);
+	    chunkmesher::getMeshDataQueue().push(mesh);
+	    uploaded++;
+	}
+
+	ring_end_frame();
+
+	const double elapsed = glfwGetTime() - start;
+	if(elapsed > budget) budget_overruns++;
+
+	debug::window::set_parameter("render_upload_backlog", (int)(pending_uploads.size() +
+		    pending_deletes.size()));
+	debug::window::set_parameter("render_uploads_frame", uploaded);
+	debug::window::set_parameter("render_deletes_frame", deleted);
+	debug::window::set_parameter("render_upload_time", (float)(elapsed * 1000.0));
+	debug::window::set_parameter("render_upload_overruns", budget_overruns);
+	debug::window::set_parameter("render_ring_used", (int)ring_used);
+	debug::window::set_parameter("render_ring_stalls", ring_stalls);
+    }
+
+    void upload_mesh(ChunkMeshData* m){
+	RenderTable::accessor a;
+	RenderInfo* render_info;
+
+	// From the click to the new mesh being on the GPU
+	if(m->edit_time > 0)
+	    debug::window::set_parameter("edit_latency_upload", (float)((glfwGetTime() - m->edit_time)
+			* 1000.0));
+
+	if(ChunksToRender.find(a, m->index)){
+	    render_info = a->second;
+	    render_info->position = m->position;
+	    render_info->num_vertices = m->num_vertices;
+	    render_info->occluders = m->occluders;
+	    render_info->connectivity = m->connectivity;
+	    render_info->direction_offsets = m->direction_offsets;
+
+	    // Always updated the mesh, even if it's empty
+	    // This should solve the problem of having floating quads when destroying a block
+	    // near chunk borders
+	    send_chunk_to_gpu(m, render_info);
+	    update_bounds(m, render_info);
+	}else{
+	    render_info = new RenderInfo();
+	    render_info->index = m->index;
+	    render_info->position = m->position;
+	    render_info->num_vertices = m->num_vertices;
+	    render_info->occluders = m->occluders;
+	    render_info->connectivity = m->connectivity;
+	    render_info->direction_offsets = m->direction_offsets;
+
+	    ChunksToRender.emplace(a, std::make_pair(render_info->index, render_info));
+
+	    // Only send the mesh to the GPU if it's not empty
+	    if(render_info->num_vertices > 0) send_chunk_to_gpu(m, render_info);
+	    update_bounds(m, render_info);
+	}
+    }
+
+    void update_bounds(ChunkMeshData* m, RenderInfo* render_info){
+	if(render_info->num_vertices > 0 && render_info->arena_offset >= 0){
+	    glm::vec3 origin = render_info->position * static_cast<float>(CHUNK_SIZE);
+	    render_info->aabb_min = origin + m->aabb_min;
+	    render_info->aabb_max = origin + m->aabb_max;
+	    culling::update(render_info);
+	}else
+	    culling::remove(render_info);
+    }
+
+    void delete_chunk(chunk_index_t index){
+	RenderTable::accessor a;
+
+	if(ChunksToRender.find(a, index)){
+	    RenderInfo* render_info = a->second;
+	    culling::remove(render_info);
+	    arena_release(render_info);
+	    slot_release(render_info);
+	    delete render_info;
+	    ChunksToRender.erase(a);
+	}
+    }
+
     void send_chunk_to_gpu(ChunkMeshData* mesh_data, RenderInfo* render_info)
     {
-	if(!render_info->buffers_allocated) render_info->allocateBuffers();
+	const uint32_t num_quads = mesh_data->quads.size();
+
+	// Always write the new mesh to a fresh range of the arena: the draw lists already built still
+	// draw the old range with the old sizes, so it's only freed once they are gone
+	arena_release(render_info);
+	// Only chunks with something to draw hold a slot. One that found none free tries again with
+	// its next mesh
+	if(num_quads == 0){
+	    slot_release(render_info);
+	    return;
+	}
+	if(render_info->slot < 0) render_info->slot = acquire_slot(render_info->position);
+	if(render_info->slot < 0 || !arena_allocate(render_info, num_quads)) return;
+
+	const uint32_t bytes = num_quads * sizeof(ChunkMeshQuad);
+	const GLintptr arena_byte_offset = render_info->arena_offset * sizeof(ChunkMeshQuad);
+
+	// Stream the mesh through the upload ring, letting the quads know which chunk they belong
+	// to while copying them
+	ChunkMeshQuad* staging = ring_reserve(bytes, arena_byte_offset);
+	if(staging != nullptr){
+	    for(uint32_t i = 0; i < num_quads; i++){
+		staging[i] = mesh_data->quads[i];
+		staging[i].setSlot(render_info->slot);
+	    }
+	    return;
+	}
 
-	// bind the Vertex Array Object first, then bind and set vertex buffer(s), and then configure vertex attributes(s).
-	glBindVertexArray(render_info->VAO);
+	// Doesn't fit in the ring, upload directly
+	for(ChunkMeshQuad& quad : mesh_data->quads) quad.setSlot(render_info->slot);
+	glBindBuffer(GL_ARRAY_BUFFER, arenaVBO);
+	glBufferSubData(GL_ARRAY_BUFFER, arena_byte_offset, bytes, mesh_data->quads.data());
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
 
-	// TODO: change GL_STATIC_DRAW to the one that means "few redraws and further in between"
+    // Start using the ring segment of this frame. Its fence was placed RING_SEGMENTS frames ago,
+    // so waiting on it is almost always free
+    void ring_begin_frame(){
+	ring_segment = (ring_segment + 1) % RING_SEGMENTS;
+	ring_used = 0;
+
+	GLsync& fence = ring_fences[ring_segment];
+	if(fence != 0){
+	    if(glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED){
+		ring_stalls++;
+		while(glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED);
+	    }
+	    glDeleteSync(fence);
+	    fence = 0;
+	}
+    }
 
-	// position attribute
-	glBindBuffer(GL_ARRAY_BUFFER, render_info->VBO);
-	glBufferData(GL_ARRAY_BUFFER, mesh_data->vertices.size() * sizeof(GLfloat), &(mesh_data->vertices[0]), GL_STATIC_DRAW);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
-	glEnableVertexAttribArray(0);
+    // Reserve bytes in this frame's ring segment, to be copied at arena_byte_offset in the arena at
+    // the end of the frame. Returns nullptr if there is not enough room left
+    ChunkMeshQuad* ring_reserve(uint32_t bytes, GLintptr arena_byte_offset){
+	if(ring_used + bytes > RING_SEGMENT_SIZE) return nullptr;
+
+	// Map the whole segment once per frame. Unsynchronized, the fence already guarantees the GPU
+	// is done with it
+	if(ring_mapped == nullptr){
+	    glBindBuffer(GL_COPY_READ_BUFFER, uploadRingVBO);
+	    ring_mapped = (char*)glMapBufferRange(GL_COPY_READ_BUFFER, ring_segment * RING_SEGMENT_SIZE,
+		    RING_SEGMENT_SIZE, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT |
+		    GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_FLUSH_EXPLICIT_BIT);
+	    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	    if(ring_mapped == nullptr) return nullptr;
+	}
 
-	// normal attribute
-	glBindBuffer(GL_ARRAY_BUFFER, render_info->extentsBuffer);
-	glBufferData(GL_ARRAY_BUFFER, mesh_data->extents.size() * sizeof(GLfloat), &(mesh_data->extents[0]), GL_STATIC_DRAW);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)(0));
-	glEnableVertexAttribArray(1);
+	ring_copies.push_back({ring_segment * RING_SEGMENT_SIZE + ring_used, arena_byte_offset, bytes});
+	ChunkMeshQuad* ptr = (ChunkMeshQuad*)(ring_mapped + ring_used);
+	ring_used += bytes;
+	return ptr;
+    }
 
-	// texcoords attribute
-	glBindBuffer(GL_ARRAY_BUFFER, render_info->texinfoBuffer);
-	glBufferData(GL_ARRAY_BUFFER, mesh_data->texinfo.size() * sizeof(GLfloat), &(mesh_data->texinfo[0]), GL_STATIC_DRAW);
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void *)0);
+    bool ring_fits(uint32_t bytes){
+	return ring_used + bytes <= RING_SEGMENT_SIZE || bytes > RING_SEGMENT_SIZE;
+    }
 
+    // Unmap the segment, copy everything that was written GPU-side into the arena and fence it
+    void ring_end_frame(){
+	if(ring_mapped == nullptr) return;
+
+	glBindBuffer(GL_COPY_READ_BUFFER, uploadRingVBO);
+	glFlushMappedBufferRange(GL_COPY_READ_BUFFER, 0, ring_used);
+	glUnmapBuffer(GL_COPY_READ_BUFFER);
+	ring_mapped = nullptr;
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, arenaVBO);
+	for(const RingCopy& copy : ring_copies)
+	    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, copy.ring_offset,
+		    copy.arena_offset, copy.size);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	ring_copies.clear();
+
+	ring_fences[ring_segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    // (Re)bind the arena buffer to the geometry shader VAO and the vertex pulling buffer texture
+    void attach_arena(){
+	glBindVertexArray(arenaVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, arenaVBO);
+	// packed quad attribute, decoded in the vertex shader
+	glVertexAttribIPointer(0, 2, GL_UNSIGNED_INT, sizeof(ChunkMeshQuad), (void *)0);
+	glEnableVertexAttribArray(0);
 	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_BUFFER, arenaTBO);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32UI, arenaVBO);
+	glActiveTexture(GL_TEXTURE0);
+    }
+
+    // Grow the arena to fit at least min_capacity quads, copying the old content GPU-side. Returns
+    // false, leaving the arena as it is, if it can't get that big
+    bool arena_grow(uint32_t min_capacity){
+	GLint max_texels;
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texels);
+
+	uint32_t old_capacity = arenaAllocator.getCapacity();
+	uint64_t new_capacity = std::max(old_capacity, 1u);
+	while(new_capacity < min_capacity) new_capacity *= 2;
+	if(new_capacity > (uint64_t)max_texels) new_capacity = max_texels;
+	if(new_capacity < min_capacity || new_capacity <= old_capacity) return false;
+
+	GLuint newVBO;
+	glGenBuffers(1, &newVBO);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, newVBO);
+	glBufferData(GL_COPY_WRITE_BUFFER, new_capacity * sizeof(ChunkMeshQuad), NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_COPY_READ_BUFFER, arenaVBO);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, old_capacity *
+		sizeof(ChunkMeshQuad));
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	glDeleteBuffers(1, &arenaVBO);
+	arenaVBO = newVBO;
+
+	arenaAllocator.grow(new_capacity);
+	attach_arena();
+	return true;
+    }
+
+    bool arena_allocate(RenderInfo* render_info, uint32_t num_quads){
+	uint32_t capacity = (num_quads + ARENA_ALLOCATION_GRANULARITY - 1) /
+	    ARENA_ALLOCATION_GRANULARITY * ARENA_ALLOCATION_GRANULARITY;
+
+	int64_t offset = arenaAllocator.allocate(capacity);
+	if(offset < 0){
+	    // The free space might be there but split in ranges too small, so the arena grows by at
+	    // least the whole allocation: the space added at the end is enough on its own
+	    if(!arena_grow(arenaAllocator.getCapacity() + capacity)){
+		std::cout << "Quad arena is full, can't render chunk " << render_info->index << std::endl;
+		return false;
+	    }
+	    offset = arenaAllocator.allocate(capacity);
+	    if(offset < 0){
+		std::cout << "Quad arena grown but still can't fit chunk " << render_info->index <<
+		    " (" << capacity << " quads)" << std::endl;
+		return false;
+	    }
+	}
+
+	render_info->arena_offset = offset;
+	render_info->arena_capacity = capacity;
+	return true;
+    }
+
+    void arena_release(RenderInfo* render_info){
+	if(render_info->arena_offset < 0) return;
+
+	deferred_frees.push_back({render_info->arena_offset, render_info->arena_capacity, -1, frame});
+	render_info->arena_offset = -1;
+	render_info->arena_capacity = 0;
+    }
+
+    void slot_release(RenderInfo* render_info){
+	if(render_info->slot < 0) return;
+
+	deferred_frees.push_back({-1, 0, render_info->slot, frame});
+	render_info->slot = -1;
+    }
+
+    void process_deferred_frees(){
+	frame++;
+	auto i = deferred_frees.begin();
+	for(; i != deferred_frees.end() && i->frame + FREE_DELAY_FRAMES <= frame; i++){
+	    if(i->arena_offset >= 0) arenaAllocator.release(i->arena_offset, i->arena_capacity);
+	    if(i->slot >= 0) free_slots.push_back(i->slot);
+	}
+	deferred_frees.erase(deferred_frees.begin(), i);
+    }
+
+    int acquire_slot(glm::vec3 position){
+	if(free_slots.empty()){
+	    std::cout << "Out of chunk slots" << std::endl;
+	    return -1;
+	}
+	int slot = free_slots.back();
+	free_slots.pop_back();
+
+	// World position of the chunk origin
+	glm::vec4 origin = glm::vec4(position * static_cast<float>(CHUNK_SIZE), 0.0);
+	glBindBuffer(GL_TEXTURE_BUFFER, chunkPositionsVBO);
+	glBufferSubData(GL_TEXTURE_BUFFER, slot * sizeof(glm::vec4), sizeof(glm::vec4), glm::value_ptr(origin));
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	return slot;
     }
 
 
@@ -336,7 +952,25 @@ namespace renderer{
     }
 
     void destroy(){
+	{
+	    std::lock_guard<std::mutex> lock(cull_mutex);
+	    cull_stop = true;
+	}
+	cull_cv.notify_all();
+	cull_thread.join();
+	farterrain::destroy();
+
 	delete theShader;
+	delete gsShader;
+
+	glDeleteBuffers(1, &arenaVBO);
+	glDeleteBuffers(1, &chunkPositionsVBO);
+	glDeleteBuffers(1, &uploadRingVBO);
+	for(GLsync fence : ring_fences) if(fence != 0) glDeleteSync(fence);
+	glDeleteTextures(1, &arenaTBO);
+	glDeleteTextures(1, &chunkPositionsTBO);
+	glDeleteVertexArrays(1, &arenaVAO);
+	glDeleteVertexArrays(1, &emptyVAO);
 	delete quadShader;
     }
 
@@ -0,0 +1,196 @@
+#include "worldedit.hpp"
+
+#include <algorithm>
+#include <array>
+#include <map>
+#include <memory>
+#include <utility>
+
+#include "chunk.hpp"
+#include "chunkmanager.hpp"
+#include "globals.hpp"
+#include "heightmap.hpp"
+#include "navigation.hpp"
+
+namespace worldedit{
+    // Layers of each chunk to mesh again at the end of an edit, one mask per dimension as in
+    // Chunk::setLayerDirty
+    typedef std::map<chunk_index_t, std::array<uint64_t, 3>> RemeshSet;
+
+    // Find a chunk that can be edited. Holding the accessor is enough to write to it: the mesher
+    // and getBlocksInRegion only read blocks under a const accessor. A mesh already queued for the
+    // chunk is left alone, the chunk is meshed again at the end of the edit anyway
+    Chunk::Chunk* acquire(chunkmanager::ChunkTable::accessor& a, chunk_index_t index){
+	if(!chunkmanager::getChunks().find(a, index)) return nullptr;
+	Chunk::Chunk* c = a->second;
+	if(!c->getState(Chunk::CHUNK_STATE_GENERATED) ||
+		c->getState(Chunk::CHUNK_STATE_IN_DELETING_QUEUE)) return nullptr;
+	return c;
+    }
+
+    void mark(RemeshSet& remesh, glm::ivec3 chunk, int dim, int layer){
+	if(chunk.x < 0 || chunk.y < 0 || chunk.z < 0 || chunk.x > 1023 || chunk.y > 1023 || chunk.z >
+		1023) return;
+	remesh[Chunk::calculateIndex(chunk.x, chunk.y, chunk.z)][dim] |= 1ULL << layer;
+    }
+
+    void remesh(const RemeshSet& remesh){
+	auto& chunks = chunkmanager::getChunks();
+	for(const auto& [index, layers] : remesh){
+	    chunkmanager::ChunkTable::accessor a;
+	    if(!chunks.find(a, index)) continue;
+	    Chunk::Chunk* c = a->second;
+	    if(!c->getState(Chunk::CHUNK_STATE_GENERATED) ||
+		    c->getState(Chunk::CHUNK_STATE_IN_DELETING_QUEUE)) continue;
+
+	    for(int d = 0; d < 3; d++)
+		for(int l = 0; l <= CHUNK_SIZE; l++)
+		    if(layers[d] & (1ULL << l)) c->setLayerDirty(d, l);
+	    chunkmanager::send_to_chunk_meshing_thread(c, MESHING_PRIORITY_PLAYER_EDIT);
+	}
+    }
+
+    // A run of blocks along the Hilbert curve of a chunk, [start, end)
+    typedef struct Run{
+	int start, end;
+	Block block;
+    } Run;
+
+    // Run f(world position, current block) over every block of [min, max] in the loaded chunks,
+    // f returns the new block. Only the runs of each chunk overlapping the Hilbert ranges of the
+    // region are read, and the blocks that changed are written back as runs of the same block
+    template<typename F>
+    size_t apply(glm::ivec3 min, glm::ivec3 max, F f){
+	min = glm::max(min, glm::ivec3(0));
+	max = glm::min(max, glm::ivec3(1024 * CHUNK_SIZE - 1));
+	if(glm::any(glm::lessThan(max, min))) return 0;
+
+	const glm::ivec3 cmin = min / CHUNK_SIZE;
+	const glm::ivec3 cmax = max / CHUNK_SIZE;
+
+	std::vector<Run> before, runs;
+	RemeshSet to_remesh;
+	size_t changed{0};
+
+	for(int cx = cmin.x; cx <= cmax.x; cx++)
+	for(int cy = cmin.y; cy <= cmax.y; cy++)
+	for(int cz = cmin.z; cz <= cmax.z; cz++){
+	    const glm::ivec3 chunk(cx, cy, cz);
+	    chunkmanager::ChunkTable::accessor a;
+	    Chunk::Chunk* c = acquire(a, Chunk::calculateIndex(cx, cy, cz));
+	    if(c == nullptr) continue;
+
+	    // Part of the region inside this chunk, in chunk coordinates
+	    const glm::ivec3 origin = chunk * CHUNK_SIZE;
+	    const glm::ivec3 lo = glm::max(min - origin, glm::ivec3(0));
+	    const glm::ivec3 hi = glm::min(max - origin, glm::ivec3(CHUNK_SIZE - 1));
+	    const auto& ranges = chunkmanager::hilbert_ranges(lo, hi);
+
+	    // Current runs of the part. The map can't change while it's walked, so they are copied
+	    // out first. Blocks past the end of the map are air
+	    before.clear();
+	    size_t r{0};
+	    auto fill_air = [&](int until){
+		for(; r < ranges.size() && ranges[r].first < until; r++){
+		    const int from = before.empty() || before.back().end < ranges[r].first ?
+			ranges[r].first : before.back().end;
+		    const int to = std::min(ranges[r].second, until);
+		    if(from < to) before.push_back({from, to, Block::AIR});
+		    if(ranges[r].second > until) break;
+		}
+	    };
+	    c->getBlocks().forEachRunInRanges(ranges, [&](int start, int end, Block b){
+		fill_air(start);
+		before.push_back({start, end, b});
+	    });
+	    fill_air(CHUNK_VOLUME);
+
+	    // Runs of changed blocks with the same new value, and the bounds of what actually
+	    // changed, to only dirty the layers that need it
+	    runs.clear();
+	    glm::ivec3 changed_lo(CHUNK_SIZE), changed_hi(-1);
+	    for(const Run& run : before)
+		for(int h = run.start; h < run.end; h++){
+		    const glm::ivec3 p(HILBERT_XYZ_DECODE[h][0], HILBERT_XYZ_DECODE[h][1],
+			    HILBERT_XYZ_DECODE[h][2]);
+		    const Block b = f(origin + p, run.block);
+		    if(b == run.block) continue;
+
+		    if(!runs.empty() && runs.back().end == h && runs.back().block == b) runs.back().end++;
+		    else runs.push_back({h, h + 1, b});
+		    changed_lo = glm::min(changed_lo, p);
+		    changed_hi = glm::max(changed_hi, p);
+		    changed++;
+		}
+	    if(runs.empty()) continue;
+
+	    if(runs.size() > WORLDEDIT_MAX_RUNS){
+		int length{0};
+		std::unique_ptr<Block[]> current = c->getBlocksArray(&length);
+		std::unique_ptr<Block[]> after(new Block[CHUNK_VOLUME]);
+		std::fill(after.get(), after.get() + CHUNK_VOLUME, Block::AIR);
+		std::copy(current.get(), current.get() + length, after.get());
+		for(const Run& run : runs) std::fill(after.get() + run.start, after.get() + run.end,
+			run.block);
+		c->setBlocksArray(after.get(), CHUNK_VOLUME);
+	    }else for(const Run& run : runs) c->setBlocks(run.start, run.end, run.block);
+	    heightmap::updateChunk(c);
+	    navigation::invalidate(chunk);
+
+	    for(int d = 0; d < 3; d++){
+		for(int l = changed_lo[d]; l <= changed_hi[d] + 1; l++) mark(to_remesh, chunk, d, l);
+
+		// Faces on the border are also meshed by the neighbour
+		glm::ivec3 offset(0);
+		offset[d] = 1;
+		if(changed_lo[d] == 0) mark(to_remesh, chunk - offset, d, CHUNK_SIZE);
+		if(changed_hi[d] == CHUNK_SIZE - 1) mark(to_remesh, chunk + offset, d, 0);
+	    }
+	}
+
+	remesh(to_remesh);
+	return changed;
+    }
+
+    size_t fill(glm::ivec3 min, glm::ivec3 max, Block b){
+	return apply(min, max, [=](glm::ivec3, Block){ return b; });
+    }
+
+    size_t ellipsoid(glm::vec3 center, glm::vec3 radii, Block b){
+	const glm::ivec3 min(glm::floor(center - radii));
+	const glm::ivec3 max(glm::ceil(center + radii));
+	return apply(min, max, [=](glm::ivec3 p, Block current){
+		// Test the center of the block
+		const glm::vec3 d = (glm::vec3(p) + glm::vec3(0.5f) - center) / radii;
+		return glm::dot(d, d) <= 1.0f ? b : current;
+	});
+    }
+
+    size_t sphere(glm::vec3 center, float radius, Block b){
+	return ellipsoid(center, glm::vec3(radius), b);
+    }
+
+    size_t replace(glm::ivec3 min, glm::ivec3 max, Block from, Block to){
+	return apply(min, max, [=](glm::ivec3, Block current){ return current == from ? to :
+		current; });
+    }
+
+    Region copy(glm::ivec3 min, glm::ivec3 max){
+	Region region;
+	if(glm::any(glm::lessThan(max, min))) return region;
+	region.size = max - min + 1;
+	region.blocks.resize(region.size.x * region.size.y * region.size.z);
+	chunkmanager::getBlocksInRegion(min, max, region.blocks.data());
+	return region;
+    }
+
+    size_t paste(const Region& region, glm::ivec3 position, bool skip_air){
+	if(region.blocks.empty()) return 0;
+	return apply(position, position + region.size - 1, [&](glm::ivec3 p, Block current){
+		const glm::ivec3 r = p - position;
+		const Block b = region.at(r.x, r.y, r.z);
+		if(b == Block::NULLBLK || (skip_air && b == Block::AIR)) return current;
+		return b;
+	});
+    }
+};